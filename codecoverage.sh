@@ -1,4 +1,4 @@
-#!/bin/bash
-
-lcov -t "tst_viflashdrv" -o tst_viflashdrv.info -c -d .
+#!/bin/bash
+
+lcov -t "tst_viflashdrv" -o tst_viflashdrv.info -c -d .
 genhtml -o report tst_viflashdrv.info
\ No newline at end of file
@@ -0,0 +1,220 @@
+#ifndef VIFLASHDRV_HPP
+#define VIFLASHDRV_HPP
+
+// Header-only C++17 front end. Geometry, FF-sector size and program width are
+// template parameters, the HAL is a policy class with static functions, so sector
+// lookups fold to constants and the compare/program loops are built for one word type.
+// The flash layout is the same as the one of the C driver.
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+#include "viflashdrv.h"
+
+namespace viflash {
+
+/*!
+Flash sectors of the disk window, the window starts at the first of them
+\tparam FirstSector - number of the first flash sector
+\tparam Sizes - size of each flash sector [B]
+*/
+template <std::uint8_t FirstSector, std::uint32_t... Sizes>
+struct Geometry {
+  static_assert(0 < sizeof...(Sizes), "Geometry needs at least one sector");
+
+  static constexpr std::uint8_t firstSector = FirstSector;
+  static constexpr std::uint32_t count = sizeof...(Sizes);
+  static constexpr std::array<std::uint32_t, count> sizes = {{Sizes...}};
+  // offset of each sector in the window, offsets[count] is the window size
+  static constexpr std::array<std::uint32_t, count + 1> offsets = [] {
+    std::array<std::uint32_t, count + 1> table{};
+    for(std::uint32_t i = 0; i < count; i++)
+      table[i + 1] = table[i] + sizes[i];
+    return table;
+  }();
+  static constexpr std::uint32_t size = offsets[count];
+  static constexpr std::uint32_t smallest = [] {
+    std::uint32_t min = sizes[0];
+    for(std::uint32_t s : sizes)
+      if(s < min)
+        min = s;
+    return min;
+  }();
+
+  // index of the sector holding a window offset
+  static constexpr std::uint32_t indexOf(std::uint32_t offset) {
+    std::uint32_t i = 0;
+    while(i + 1 < count && offsets[i + 1] <= offset)
+      i++;
+    return i;
+  }
+
+  static constexpr bool dividedBy(std::uint32_t unit) {
+    for(std::uint32_t s : sizes)
+      if(0 != s % unit)
+        return false;
+    return true;
+  }
+};
+
+namespace detail {
+
+template <std::uint32_t Width> struct WordOf;
+template <> struct WordOf<1> { using type = std::uint8_t; };
+template <> struct WordOf<2> { using type = std::uint16_t; };
+template <> struct WordOf<4> { using type = std::uint32_t; };
+template <> struct WordOf<8> { using type = std::uint64_t; };
+
+template <typename Word>
+inline Word load(const std::uint8_t *ptr) {
+  Word word;
+  std::memcpy(&word, ptr, sizeof(Word));
+  return word;
+}
+
+inline const std::uint8_t* flash(std::uintptr_t address) {
+  return reinterpret_cast<const std::uint8_t*>(address);
+}
+
+} // namespace detail
+
+/*!
+FatFs disk on internal flash. Hal is a class with static functions:
+  std::uintptr_t address(std::uint8_t sector) - start of a flash sector
+  bool unlock(), void lock()
+  bool erase(std::uint8_t sector) - blocks until the sector is erased
+  bool program(std::uintptr_t address, Word data) - Word of ProgramWidth bytes
+\tparam Geometry - viflash::Geometry of the disk window
+\tparam FfSectorSize - FatFs sector size [B]
+\tparam ProgramWidth - bytes per program operation (1, 2, 4 or 8)
+\tparam Hal - flash access policy
+*/
+template <typename Geometry, std::uint32_t FfSectorSize, std::uint32_t ProgramWidth, typename Hal>
+class Disk {
+public:
+  using Word = typename detail::WordOf<ProgramWidth>::type;
+
+  static_assert(0 == FfSectorSize % ProgramWidth, "FF sector must hold whole program words");
+  static_assert(Geometry::dividedBy(FfSectorSize), "Flash sectors must hold whole FF sectors");
+
+  static constexpr std::uint32_t sectorCount = Geometry::size / FfSectorSize;
+  static constexpr std::uint32_t sectorSize = FfSectorSize;
+  static constexpr std::uint32_t blockSize = Geometry::smallest / FfSectorSize;
+
+  VIFLASH_Result_t write(const std::uint8_t *buff, std::uint32_t sector, std::uint32_t count) {
+    if(writeProtected)
+      return VIFLASH_RESULT_WRPRT;
+    if(nullptr == buff || 0 == count || sectorCount < count || sectorCount - count < sector)
+      return VIFLASH_RESULT_PARERR;
+
+    writeProtected = true;
+    const std::uint32_t start = sector * FfSectorSize;
+    const std::uint32_t stop = start + count * FfSectorSize;
+    bool success = true;
+    for(std::uint32_t i = Geometry::indexOf(start);
+        success && i < Geometry::count && Geometry::offsets[i] < stop; i++) {
+      const std::uint32_t from = (start > Geometry::offsets[i]) ? start : Geometry::offsets[i];
+      const std::uint32_t to = (stop < Geometry::offsets[i + 1]) ? stop : Geometry::offsets[i + 1];
+      success = writeSector(i, buff + (from - start), from, to - from);
+    }
+    writeProtected = false;
+    return success ? VIFLASH_RESULT_OK : VIFLASH_RESULT_ERROR;
+  }
+
+  VIFLASH_Result_t read(std::uint8_t *buff, std::uint32_t sector, std::uint32_t count) const {
+    if(writeProtected)
+      return VIFLASH_RESULT_NOTRDY;
+    if(nullptr == buff || 0 == count || sectorCount < count || sectorCount - count < sector)
+      return VIFLASH_RESULT_PARERR;
+    std::memcpy(buff, detail::flash(base() + sector * FfSectorSize), count * FfSectorSize);
+    return VIFLASH_RESULT_OK;
+  }
+
+  VIFLASH_Result_t ioctl(std::uint8_t cmd, void *buff) const {
+    switch(cmd) {
+      case VIFLASH_CTRL_SYNC:
+      case VIFLASH_CTRL_TRIM:
+        return VIFLASH_RESULT_OK;
+      case VIFLASH_GET_SECTOR_COUNT:
+      case VIFLASH_GET_SECTOR_SIZE:
+      case VIFLASH_GET_BLOCK_SIZE: {
+        if(nullptr == buff)
+          return VIFLASH_RESULT_PARERR;
+        const std::uint32_t value = (VIFLASH_GET_SECTOR_COUNT == cmd) ? sectorCount :
+          ((VIFLASH_GET_SECTOR_SIZE == cmd) ? sectorSize : blockSize);
+        std::memcpy(buff, &value, sizeof(value));
+        return VIFLASH_RESULT_OK;
+      }
+    }
+    return VIFLASH_RESULT_PARERR;
+  }
+
+  bool isWriteProtected() const {
+    return writeProtected;
+  }
+
+private:
+  static constexpr Word blank = static_cast<Word>(~static_cast<Word>(0));
+
+  bool writeProtected = false;
+
+  static std::uintptr_t base() {
+    return Hal::address(Geometry::firstSector);
+  }
+
+  // program the words which differ, blank words are left out
+  static bool program(std::uintptr_t address, const std::uint8_t *data, std::uint32_t size) {
+    for(std::uint32_t i = 0; i < size; i += ProgramWidth) {
+      const Word word = detail::load<Word>(data + i);
+      if(blank != word && detail::load<Word>(detail::flash(address + i)) != word) {
+        if(!Hal::program(address + i, word))
+          return false;
+      }
+    }
+    return true;
+  }
+
+  // merge a range into one flash sector, erase it only if a written byte has to change
+  static bool writeSector(std::uint32_t index, const std::uint8_t *data,
+                          std::uint32_t from, std::uint32_t size) {
+    const std::uintptr_t sectorAddress = Hal::address(Geometry::firstSector + index);
+    const std::uintptr_t address = sectorAddress + (from - Geometry::offsets[index]);
+    const std::uint8_t *current = detail::flash(address);
+
+    bool enableWrite = false;
+    bool enableErase = false;
+    for(std::uint32_t i = 0; i < size; i++) {
+      enableWrite |= (current[i] != data[i]);
+      enableErase |= (0xFF != current[i]) & (current[i] != data[i]);
+    }
+    if(!enableWrite)
+      return true;
+    if(!Hal::unlock())
+      return false;
+
+    bool success = true;
+    if(!enableErase) {
+      success = program(address, data, size);
+    } else {
+      const std::uint32_t sectorSize = Geometry::sizes[index];
+      std::uint8_t *merged = static_cast<std::uint8_t*>(std::malloc(sectorSize));
+      success = (nullptr != merged);
+      if(success) {
+        std::memcpy(merged, detail::flash(sectorAddress), sectorSize);
+        std::memcpy(merged + (address - sectorAddress), data, size);
+        success = Hal::erase(Geometry::firstSector + index) &&
+                  program(sectorAddress, merged, sectorSize);
+        std::free(merged);
+      }
+    }
+    Hal::lock();
+    return success;
+  }
+};
+
+} // namespace viflash
+
+#endif // VIFLASHDRV_HPP
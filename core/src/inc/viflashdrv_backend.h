@@ -0,0 +1,109 @@
+#ifndef VIFLASHDRV_BACKEND_H
+#define VIFLASHDRV_BACKEND_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "viflashdrv.h"
+
+/*!
+Read from the backend address space
+\param[in] context - backend context
+\param[in] address - first byte
+\param[out] buff - data
+\param[in] size - number of bytes
+*/
+typedef bool (*VIFLASH_BackendRead_t)(void *context, size_t address, uint8_t *buff, uint32_t size);
+/*!
+Program erased flash, bits only go from 1 to 0; address and size are word aligned
+*/
+typedef bool (*VIFLASH_BackendProgram_t)(void *context, size_t address, const uint8_t *data, uint32_t size);
+/*!
+Erase the erase unit starting at an address
+*/
+typedef bool (*VIFLASH_BackendErase_t)(void *context, size_t unitAddress);
+/*!
+Open or close the flash for program and erase, optional
+*/
+typedef bool (*VIFLASH_BackendLock_t)(void *context);
+/*!
+Smallest erase unit holding an address
+\param[out] unitAddress - start of the unit
+\return size of the unit [B], 0 if the address is outside of the device
+*/
+typedef uint32_t (*VIFLASH_BackendUnit_t)(void *context, size_t address, size_t *unitAddress);
+/*!
+Erase unit by number (flash sector number of the internal flash)
+\param[out] address - start of the unit
+\return size of the unit [B], 0 if there is no such unit
+*/
+typedef uint32_t (*VIFLASH_BackendSector_t)(void *context, uint32_t number, size_t *address);
+
+// Storage operations of the driver: read-modify-write works on the units of unitCb
+typedef struct {
+  VIFLASH_BackendRead_t readCb;
+  VIFLASH_BackendProgram_t programCb;
+  VIFLASH_BackendErase_t eraseCb;
+  VIFLASH_BackendUnit_t unitCb;
+  VIFLASH_BackendSector_t sectorCb;
+  VIFLASH_BackendLock_t unlockCb;   /* may be NULL */
+  VIFLASH_BackendLock_t lockCb;     /* may be NULL */
+  void *context;
+  bool memoryMapped;    /* content readable by the CPU at mapBase + address */
+  size_t mapBase;
+} VIFLASH_Backend_t;
+
+/*!
+One chip select cycle of a SPI/QSPI bus: command bytes out, then size bytes out
+of tx or into rx (both NULL if there is no data phase)
+*/
+typedef bool (*VIFLASH_SpiTransfer_t)(void *context, const uint8_t *cmd, uint32_t cmdSize,
+  const uint8_t *tx, uint8_t *rx, uint32_t size);
+
+// SPI NOR flash with the common command set (03h read, 02h page program, 20h sector erase)
+typedef struct {
+  VIFLASH_SpiTransfer_t transferCb;
+  void *context;           /* passed to transferCb */
+  uint32_t size;           /* device size [B] */
+  uint32_t pageSize;       /* page program size [B], usually 256 */
+  uint32_t eraseSize;      /* smallest erase (20h) [B], usually 4096 */
+  uint8_t addressBytes;    /* 3, or 4 if the device is in 4-byte address mode */
+} VIFLASH_SpiNor_t;
+
+typedef struct {
+  uint8_t *memory;
+  uint32_t size;           /* [B] */
+  uint32_t eraseSize;      /* granularity of the read-modify-write [B] */
+} VIFLASH_RamDisk_t;
+
+/*!
+Driver initialization with a storage backend, addresses are backend addresses
+\param[in] backend - storage operations, copied
+\param[in] startDiskAddress - first byte of the disk window
+\param[in] endDiskAddress - first byte behind the disk window
+\param[in] ffSectorSize - FatFs sector size [B]
+*/
+bool VIFLASH_InitBackend(const VIFLASH_Backend_t *backend,
+  size_t startDiskAddress, size_t endDiskAddress, uint32_t ffSectorSize);
+
+/*!
+Backend for a SPI NOR flash: addresses are device offsets, erase units are
+the 4 KB sectors (eraseSize) instead of the 64 KB blocks
+\param[in] nor - device description, must stay valid while the backend is used
+\param[out] backend - operations for VIFLASH_InitBackend
+*/
+bool VIFLASH_SpiNorBackend(VIFLASH_SpiNor_t *nor, VIFLASH_Backend_t *backend);
+
+/*!
+Backend for a RAM disk: addresses are offsets in memory
+\param[in] ram - memory description, must stay valid while the backend is used
+\param[out] backend - operations for VIFLASH_InitBackend
+*/
+bool VIFLASH_RamBackend(VIFLASH_RamDisk_t *ram, VIFLASH_Backend_t *backend);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIFLASHDRV_BACKEND_H
@@ -0,0 +1,39 @@
+#ifndef VIFLASHDRV_BLANK_H
+#define VIFLASHDRV_BLANK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "viflashdrv.h"
+
+// Bitmap size [words] for a disk window of sectors FF sectors
+#define VIFLASH_BLANK_WORDS(sectors)  (((sectors) + 31U) / 32U)
+
+typedef struct {
+  uint32_t scanSectors;     /* FF sectors of the disk window */
+  uint32_t blankSectors;    /* FF sectors found blank by the scan */
+  uint32_t scanTicks;       /* duration of the scan [ticks of tickCb] */
+  uint32_t blankWrites;     /* erase units written without read and erase decision */
+} VIFLASH_BlankStats_t;
+
+/*!
+Enable the erased-state bitmap: one bit per FF sector of the disk window, set
+while the sector is known to be blank. The whole window is scanned word-wide
+now, the bitmap follows every program and erase of the driver afterwards.
+A write whose sectors are all known blank is programmed directly, without
+reading the erase unit and without the erase decision.
+Must be called after VIFLASH_InitDriver, the bitmap stays owned by the caller.
+\param[in] bitmap - VIFLASH_BLANK_WORDS(window size / FF sector size) words, NULL disables
+\param[in] words - size of the bitmap [words]
+\param[in] tickCb - time base for the scan duration, may be NULL
+*/
+bool VIFLASH_EnableBlankMap(uint32_t *bitmap, uint32_t words, VIFLASH_GetTick_t tickCb);
+
+void VIFLASH_BlankGetStats(VIFLASH_BlankStats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIFLASHDRV_BLANK_H
@@ -0,0 +1,55 @@
+#ifndef VIFLASHDRV_CMP_H
+#define VIFLASHDRV_CMP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "viflashdrv.h"
+
+// Size of the codec hash table (power of two), one entry costs 2 bytes of stack
+#ifndef VIFLASH_CMP_HASH_SIZE
+#define VIFLASH_CMP_HASH_SIZE  256
+#endif
+// Record header + sector number + checksum [B]
+#define VIFLASH_CMP_RECORD_OVERHEAD  12
+
+typedef struct {
+  uint32_t sectorsWritten;  /* FF sectors passed to VIFLASH_Write */
+  uint32_t bytesIn;         /* logical bytes written */
+  uint32_t bytesStored;     /* record bytes put to flash */
+  uint32_t fillSectors;     /* sectors stored as a single byte value */
+  uint32_t rawSectors;      /* incompressible sectors */
+  uint32_t skipped;         /* sectors equal to the stored ones */
+  uint32_t appends;         /* records appended behind the previous ones */
+  uint32_t collections;     /* erase units reclaimed */
+  uint32_t copiedBytes;     /* live record bytes moved by the collections */
+} VIFLASH_CmpStats_t;
+
+/*!
+Enable the compression mode. Every FF sector is stored as a record of its compressed
+size, appended behind the newest record of the disk window with word programs only;
+a RAM index of 4 bytes per sector points to the newest record of each sector. When the
+free erase units run low, the unit with the most outdated bytes is reclaimed: its live
+records are copied behind the newest one and it is erased. One erase unit stays free
+for that. Sectors of one byte value are stored without payload, incompressible sectors
+as is. By default the disk offers at most as many sectors as fit as incompressible
+records besides the free units, so every write fits whatever the data. With overcommit
+the disk offers the given number of sectors, more than the plain layout if the data
+compresses; VIFLASH_Write then fails with VIFLASH_RESULT_ERROR when the live records
+do not fit anymore, which can corrupt the filesystem in the middle of an update.
+The index is rebuilt from flash, so a volume survives enabling again with the same
+arguments; it has to be formatted after the first enable.
+Must be called after VIFLASH_InitDriver.
+\param[in] sectors - number of FF sectors of the disk, 0 disables compression
+\param[in] overcommit - offer sectors beyond the worst case, data can be lost
+*/
+bool VIFLASH_EnableCompression(uint32_t sectors, bool overcommit);
+
+void VIFLASH_CmpGetStats(VIFLASH_CmpStats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIFLASHDRV_CMP_H
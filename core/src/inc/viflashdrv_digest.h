@@ -0,0 +1,43 @@
+#ifndef VIFLASHDRV_DIGEST_H
+#define VIFLASHDRV_DIGEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "viflashdrv.h"
+
+// Table size [words] for a disk of sectors FF sectors: one digest per sector + valid bits
+#define VIFLASH_DIGEST_WORDS(sectors)  ((sectors) + ((sectors) + 31U) / 32U)
+
+typedef struct {
+  uint32_t skipped;         /* FF sectors not written, the digest was equal */
+  uint32_t written;         /* FF sectors written through the table */
+  uint32_t learned;         /* digests taken from the flash content (scan, read) */
+  uint32_t invalidated;     /* digests dropped by queue writes and failed writes */
+} VIFLASH_DigestStats_t;
+
+/*!
+Enable the digest table: a CRC32 of every FF sector in RAM. VIFLASH_Write drops
+leading and trailing sectors whose digest equals the digest of the new data, a write
+with only equal sectors returns at once without touching the flash. Digests are
+taken from written data, from VIFLASH_Read or from a scan of the disk; merged queue
+writes and failed writes drop the digests of the touched sectors.
+VIFLASH_EstimateWrite leaves out the same sectors.
+A sector is compared by its CRC32 only: new data with the same CRC32 as the stored
+content (a collision, about 1 in 2^32 for unrelated data) is dropped without any
+error and the flash keeps the old content. Do not enable the table where that is
+not acceptable. Not used in compression mode. Must be called after VIFLASH_InitDriver, the table stays owned by the caller.
+\param[in] table - VIFLASH_DIGEST_WORDS(sector count) words, NULL disables the table
+\param[in] words - size of the table [words]
+\param[in] scan - read the whole disk now, otherwise the table fills while running
+*/
+bool VIFLASH_EnableDigest(uint32_t *table, uint32_t words, bool scan);
+
+void VIFLASH_DigestGetStats(VIFLASH_DigestStats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIFLASHDRV_DIGEST_H
@@ -0,0 +1,68 @@
+#ifndef VIFLASHDRV_FMT_H
+#define VIFLASHDRV_FMT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "viflashdrv.h"
+
+// Smallest cluster count accepted for a layout
+#define VIFLASH_FMT_MIN_CLUSTERS  16
+// Biggest cluster allowed by the FAT specification [FF-sectors]
+#define VIFLASH_FMT_MAX_CLUSTER   128
+
+// FAT volume layout computed from the erase geometry of the disk window.
+// All positions and sizes are in FF-sectors relative to the disk start.
+typedef struct {
+  uint32_t bytesPerSector;   /* FF-sector size [B] */
+  uint32_t totalSectors;     /* FF-sectors in the disk window */
+  uint8_t  fatType;          /* 12 or 16 */
+  uint8_t  numFats;          /* FAT copies */
+  uint16_t rootEntries;      /* root directory entries (rounded up to fill whole sectors) */
+  uint32_t clusterSize;      /* FF-sectors per cluster (au_size = clusterSize * bytesPerSector) */
+  uint32_t reservedSectors;  /* boot sector + padding up to the first FAT */
+  uint32_t fatSectors;       /* FF-sectors per FAT copy (including alignment padding) */
+  uint32_t rootDirSectors;   /* FF-sectors of the root directory */
+  uint32_t dataStartSector;  /* first FF-sector of the data area, on an erase boundary */
+  uint32_t clusterCount;     /* clusters in the data area */
+  uint32_t dataAlign;        /* FF-sectors; value for MKFS_PARM.align */
+  uint32_t fatEraseSize;     /* bytes erased by a rewrite of the first FAT sector */
+  uint32_t dataEraseSize;    /* average bytes erased by a rewrite of one cluster */
+  uint32_t eraseCostPerClusterWrite; /* fatEraseSize + dataEraseSize [B] */
+} VIFLASH_Format_t;
+
+/*!
+Compute the FAT layout with the lowest erase cost for the initialized disk window.
+The FAT is moved to the start of the smallest erase sector behind the boot sector
+when the boot sector lies in a bigger one, the data area begins on an erase boundary
+and the cluster size is the biggest power of two which never straddles an erase
+sector. The FAT type follows the cluster count the way FatFs reads it: FAT12 up to
+4085 clusters, FAT16 up to 65525.
+\param[in] numFats - number of FAT copies (1 or 2)
+\param[in] rootEntries - minimal number of root directory entries
+\param[out] fmt - computed layout
+\return false if driver not initialized or no FAT12/16 layout fits the window
+*/
+bool VIFLASH_ComputeFormat(uint8_t numFats, uint16_t rootEntries,
+  VIFLASH_Format_t *fmt);
+
+/*!
+Fill a FAT12/16 boot sector (BPB) for the layout
+\param[in] fmt - layout computed by VIFLASH_ComputeFormat
+\param[out] buff - buffer of fmt->bytesPerSector bytes
+*/
+void VIFLASH_BuildBootSector(const VIFLASH_Format_t *fmt, uint8_t *buff);
+
+/*!
+Write boot sector, empty FATs and empty root directory of the layout to the disk.
+The result can be mounted by FatFs (f_mount) without calling f_mkfs.
+\param[in] fmt - layout computed by VIFLASH_ComputeFormat
+*/
+VIFLASH_Result_t VIFLASH_FormatVolume(const VIFLASH_Format_t *fmt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIFLASHDRV_FMT_H
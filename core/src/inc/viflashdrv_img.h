@@ -0,0 +1,56 @@
+#ifndef VIFLASHDRV_IMG_H
+#define VIFLASHDRV_IMG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "viflashdrv.h"
+
+#define VIFLASH_IMG_MAGIC        0x474D4956U  /* "VIMG" */
+#define VIFLASH_IMG_VERSION      1
+// Header: magic, version, FF-sector size, FF-sectors, chunks
+#define VIFLASH_IMG_HEADER_SIZE  20
+// Chunk: first FF-sector, FF-sectors, CRC32
+#define VIFLASH_IMG_CHUNK_SIZE   12
+// Manifest size for a number of chunks, including the trailing CRC32
+#define VIFLASH_IMG_MANIFEST_SIZE(chunks) \
+  (VIFLASH_IMG_HEADER_SIZE + (chunks) * VIFLASH_IMG_CHUNK_SIZE + 4)
+
+typedef struct {
+  uint32_t chunks;          /* chunks in the manifest */
+  uint32_t badChunks;       /* chunks with a wrong CRC */
+  uint32_t firstBadSector;  /* first FF-sector of the first bad chunk */
+} VIFLASH_ImgReport_t;
+
+/*!
+Number of chunks of the disk: one per erase sector of the disk window
+*/
+uint32_t VIFLASH_ImgChunks(void);
+
+/*!
+Build the manifest of the current disk content: a CRC32 per erase sector of the
+window, encoded little endian and protected by a CRC32 of its own.
+Used by the host image builder, works the same on the target.
+\param[out] manifest - buffer of VIFLASH_IMG_MANIFEST_SIZE(VIFLASH_ImgChunks()) bytes
+\param[in] size - buffer size [B]
+\return manifest size [B], 0 on error
+*/
+uint32_t VIFLASH_ImgBuildManifest(uint8_t *manifest, uint32_t size);
+
+/*!
+Verify the disk against a manifest, e.g. at first boot after provisioning
+\param[in] manifest - manifest written by the image builder
+\param[in] size - manifest size [B]
+\param[out] report - result per chunk, may be NULL
+\return VIFLASH_RESULT_PARERR if the manifest is damaged or made for another
+  disk geometry, VIFLASH_RESULT_ERROR if a chunk differs
+*/
+VIFLASH_Result_t VIFLASH_ImgVerify(const uint8_t *manifest, uint32_t size,
+  VIFLASH_ImgReport_t *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIFLASHDRV_IMG_H
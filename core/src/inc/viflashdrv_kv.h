@@ -0,0 +1,66 @@
+#ifndef VIFLASHDRV_KV_H
+#define VIFLASHDRV_KV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "viflashdrv.h"
+
+// Capacity of the RAM index (power of two), one entry costs 8 bytes
+#ifndef VIFLASH_KV_MAX_KEYS
+#define VIFLASH_KV_MAX_KEYS  64
+#endif
+// Biggest value [B]
+#define VIFLASH_KV_MAX_VALUE 0x7FFF
+// Keys above are reserved
+#define VIFLASH_KV_MAX_KEY   0xFFFD
+
+typedef struct {
+  uint32_t keys;          /* live keys */
+  uint32_t usedBytes;     /* bytes appended to the active sector */
+  uint32_t freeBytes;     /* bytes left in the active sector */
+  uint32_t compactions;   /* sector swaps since init */
+  uint32_t wordsProgrammed;
+} VIFLASH_KvStats_t;
+
+/*!
+Initialize the key/value store on its own flash sectors. Records are appended
+with word programs only; when a sector is full the next one is taken and the
+oldest one is compacted into it and erased. The RAM index is rebuilt from flash.
+\param[in] firstSector - first flash sector of the store, outside of the disk window
+\param[in] sectorCount - number of flash sectors (at least 2)
+*/
+bool VIFLASH_KvInit(uint8_t firstSector, uint8_t sectorCount);
+
+/*!
+Store a value
+\param[in] key - 0 .. VIFLASH_KV_MAX_KEY
+\param[in] value - value data
+\param[in] size - value size [B]
+*/
+VIFLASH_Result_t VIFLASH_KvSet(uint16_t key, const void *value, uint16_t size);
+
+/*!
+Read a value
+\param[in] key - 0 .. VIFLASH_KV_MAX_KEY
+\param[out] value - buffer
+\param[in] size - buffer size [B]
+\param[out] read - value size [B], may be NULL
+\return VIFLASH_RESULT_ERROR if the key is not stored
+*/
+VIFLASH_Result_t VIFLASH_KvGet(uint16_t key, void *value, uint16_t size, uint16_t *read);
+
+/*!
+Remove a value
+\param[in] key - 0 .. VIFLASH_KV_MAX_KEY
+*/
+VIFLASH_Result_t VIFLASH_KvDelete(uint16_t key);
+
+void VIFLASH_KvGetStats(VIFLASH_KvStats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIFLASHDRV_KV_H
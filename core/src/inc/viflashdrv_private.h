@@ -1,75 +1,233 @@
-#ifndef VIFLASHDRV_PRIVATE_H
-#define VIFLASHDRV_PRIVATE_H
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-#include "viflashdrv.h"
-
-#define TYPEPROGRAM_BYTE        0x00000000U  /*!< Program byte (8-bit) at a specified address           */
-#define TYPEPROGRAM_HALFWORD    0x00000001U  /*!< Program a half-word (16-bit) at a specified address   */
-#define TYPEPROGRAM_WORD        0x00000002U  /*!< Program a word (32-bit) at a specified address        */
-#define TYPEPROGRAM_DOUBLEWORD  0x00000003U  /*!< Program a double word (64-bit) at a specified address */
-
-
-#define TYPEERASE_SECTORS       0x00000000U  /*!< Sectors erase only          */
-#define TYPEERASE_MASSERASE     0x00000001U  /*!< Flash Mass erase activation */
-
-#define VOLTAGE_RANGE_1         0x00000000U  /*!< Device operating range: 1.8V to 2.1V                */
-#define VOLTAGE_RANGE_2         0x00000001U  /*!< Device operating range: 2.1V to 2.7V                */
-#define VOLTAGE_RANGE_3         0x00000002U  /*!< Device operating range: 2.7V to 3.6V                */
-#define VOLTAGE_RANGE_4         0x00000003U  /*!< Device operating range: 2.7V to 3.6V + External Vpp */
-
-#define FLASH_BANK_1            1U /*!< Bank 1   */
-#define FLASH_BANK_2            2U /*!< Bank 2   */
-#define FLASH_BANK_BOTH         ((uint32_t)FLASH_BANK_1 | FLASH_BANK_2) /*!< Bank1 and Bank2  */
-
-// exacte copy of HAL_StatusTypeDef
-typedef enum 
-{
-  STATUS_OK       = 0x00U,
-  STATUS_ERROR    = 0x01U,
-  STATUS_BUSY     = 0x02U,
-  STATUS_TIMEOUT  = 0x03U
-} Status_t;
-
-typedef struct {
-  // write controll
-  size_t stopFlashAddr;
-  uint32_t stopFlashSector;
-  size_t startFlashAddr;
-  uint32_t startFlashSector;
-
-  uint8_t* currentFlashAddrPtr;
-  uint8_t* currentBufferPtr;
-
-  void* sectorBuffer;
-}WriteCtrl_t;
-
-typedef struct {
-  VIFLASH_Program_t programCb;
-  VIFLASH_Unlock_t unlockCb;
-  VIFLASH_Lock_t lockCb;
-  VIFLASH_EraseSector_t eraseSecCb;
-  VIFLASH_SectorToAddress_t sectorToAddrCb;
-  VIFLASH_AddressToSector_t addrToSectorCb;
-  VIFLASH_SectorSize_t sectorSizeCb;
-
-  size_t startDiskAddress;
-  size_t endDiskAddress;
-  uint32_t ffSectorSize;
-  bool initialized;
-  bool writeProtected;
-
-  WriteCtrl_t wrtCtrl;
-
-  VIFLASH_Printf_t printfCb;
-  VIFLASH_DebugLvl_t debugLvl;
-}Driver_t;
-
-#ifdef __cplusplusq
-}
-#endif
-
+#ifndef VIFLASHDRV_PRIVATE_H
+#define VIFLASHDRV_PRIVATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "viflashdrv.h"
+#include "viflashdrv_trace.h"
+#include "viflashdrv_backend.h"
+
+#define TYPEPROGRAM_BYTE        0x00000000U  /*!< Program byte (8-bit) at a specified address           */
+#define TYPEPROGRAM_HALFWORD    0x00000001U  /*!< Program a half-word (16-bit) at a specified address   */
+#define TYPEPROGRAM_WORD        0x00000002U  /*!< Program a word (32-bit) at a specified address        */
+#define TYPEPROGRAM_DOUBLEWORD  0x00000003U  /*!< Program a double word (64-bit) at a specified address */
+
+
+#define TYPEERASE_SECTORS       0x00000000U  /*!< Sectors erase only          */
+#define TYPEERASE_MASSERASE     0x00000001U  /*!< Flash Mass erase activation */
+
+#define VOLTAGE_RANGE_1         0x00000000U  /*!< Device operating range: 1.8V to 2.1V                */
+#define VOLTAGE_RANGE_2         0x00000001U  /*!< Device operating range: 2.1V to 2.7V                */
+#define VOLTAGE_RANGE_3         0x00000002U  /*!< Device operating range: 2.7V to 3.6V                */
+#define VOLTAGE_RANGE_4         0x00000003U  /*!< Device operating range: 2.7V to 3.6V + External Vpp */
+
+#define FLASH_BANK_1            1U /*!< Bank 1   */
+#define FLASH_BANK_2            2U /*!< Bank 2   */
+#define FLASH_BANK_BOTH         ((uint32_t)FLASH_BANK_1 | FLASH_BANK_2) /*!< Bank1 and Bank2  */
+
+// exacte copy of HAL_StatusTypeDef
+typedef enum 
+{
+  STATUS_OK       = 0x00U,
+  STATUS_ERROR    = 0x01U,
+  STATUS_BUSY     = 0x02U,
+  STATUS_TIMEOUT  = 0x03U
+} Status_t;
+
+typedef struct {
+  // write controll
+  size_t stopFlashAddr;
+  size_t startFlashAddr;
+
+  uint8_t* sectorBuffer;
+}WriteCtrl_t;
+
+typedef struct {
+  VIFLASH_TraceSink_t sinkCb;
+  VIFLASH_GetTick_t tickCb;
+  bool hashData;
+  uint32_t dropped;
+}TraceCtrl_t;
+
+typedef struct {
+  VIFLASH_Program_t programCb;
+  VIFLASH_Unlock_t unlockCb;
+  VIFLASH_Lock_t lockCb;
+  VIFLASH_EraseSector_t eraseSecCb;
+  VIFLASH_SectorToAddress_t sectorToAddrCb;
+  VIFLASH_AddressToSector_t addrToSectorCb;
+  VIFLASH_SectorSize_t sectorSizeCb;
+
+  // storage operations, wrap the callbacks above for the internal flash
+  VIFLASH_Backend_t backend;
+
+  size_t startDiskAddress;
+  size_t endDiskAddress;
+  uint32_t ffSectorSize;
+  bool initialized;
+  bool writeProtected;
+
+  WriteCtrl_t wrtCtrl;
+
+  VIFLASH_Printf_t printfCb;
+  VIFLASH_DebugLvl_t debugLvl;
+
+  TraceCtrl_t trace;
+
+  // compression mode: number of FF-sectors of the disk, 0 if disabled
+  uint32_t cmpSectors;
+
+  // digest table enabled (viflashdrv_digest.c)
+  bool digest;
+  // erased-state bitmap enabled (viflashdrv_blank.c)
+  bool blankMap;
+
+  // operation times of VIFLASH_EstimateWrite
+  VIFLASH_CostModel_t costModel;
+}Driver_t;
+
+/*!
+Access to the driver instance for the driver modules (format helper, etc.)
+*/
+Driver_t* VIFLASH_GetDriver(void);
+
+/*!
+Backend of the internal flash on top of the HAL callbacks of the driver
+*/
+void VIFLASH_InternalBackend(Driver_t *drv, VIFLASH_Backend_t *backend);
+
+/*!
+Read from the backend
+\param[in] address - backend address
+\param[out] buff - data
+\param[in] size - number of bytes
+*/
+bool VIFLASH_FlashRead(size_t address, uint8_t *buff, uint32_t size);
+
+/*!
+Flash content for reading: pointer into the memory map if the backend has one,
+otherwise the content is read into scratch
+\param[in] address - backend address
+\param[in] scratch - buffer of size bytes, used for backends without memory map
+\param[in] size - number of bytes
+\return NULL on read error
+*/
+const uint8_t* VIFLASH_FlashMap(size_t address, uint8_t *scratch, uint32_t size);
+
+/*!
+Open the flash for VIFLASH_FlashProgram/VIFLASH_FlashErase, close it afterwards
+with VIFLASH_FlashLock also if the unlock failed
+*/
+bool VIFLASH_FlashUnlock(void);
+void VIFLASH_FlashLock(void);
+
+/*!
+Program erased flash through the backend, blank words are left out
+*/
+bool VIFLASH_FlashProgram(size_t address, const uint8_t *data, uint32_t size);
+
+/*!
+Erase the erase unit starting at an address
+*/
+bool VIFLASH_FlashErase(size_t unitAddress);
+
+/*!
+Smallest erase unit of the backend holding an address
+\param[out] unitAddress - start of the unit
+\return size of the unit [B], 0 if there is none
+*/
+uint32_t VIFLASH_FlashUnit(size_t address, size_t *unitAddress);
+
+/*!
+Find the flash (erase) sector holding an FF-sector
+\param[in] ffSector - FF-sector number relative to the disk start
+\param[out] unitStart - first FF-sector of the erase sector inside the disk window
+\param[out] unitEnd - FF-sector behind the erase sector, clipped to the disk window
+\return size of the erase sector [B]
+*/
+uint32_t VIFLASH_EraseUnit(uint32_t ffSector, uint32_t *unitStart, uint32_t *unitEnd);
+
+/*!
+Emit a trace record for a finished driver call
+\param[in] op - VIFLASH_TraceOp_t
+\param[in] cmd - ioctl command
+\param[in] sector - first FF-sector
+\param[in] count - FF-sectors
+\param[in] buff - written data or NULL
+\param[in] res - result of the call
+\param[in] startTick - tick at call entry
+*/
+void VIFLASH_TraceCall(uint8_t op, uint8_t cmd, uint32_t sector, uint32_t count,
+  const uint8_t *buff, VIFLASH_Result_t res, uint32_t startTick);
+uint32_t VIFLASH_TraceTick(void);
+
+typedef struct {
+  const uint8_t *data;
+  size_t address;
+  uint32_t size;
+}VIFLASH_Segment_t;
+
+/*!
+Number of FF-sectors of the disk
+*/
+uint32_t VIFLASH_DiskSectors(void);
+
+/*!
+Write several flash ranges with one read-modify-write of each touched flash sector.
+Where segments overlap the later one wins. The digests of the segments are dropped.
+\param[in] segments - ranges to write
+\param[in] count - number of segments
+*/
+VIFLASH_Result_t VIFLASH_WriteSegments(const VIFLASH_Segment_t *segments, uint32_t count);
+
+/*!
+Write a flash range with read-modify-write of the touched flash sectors.
+Flash sectors are erased only if a bit has to change from 0 to 1.
+Digests of the range are left to the caller, only a failed write drops them.
+\param[in] buff - new content of the range
+\param[in] address - start of the range
+\param[in] size - size of the range [B]
+*/
+VIFLASH_Result_t VIFLASH_WriteRange(const uint8_t *buff, size_t address, uint32_t size);
+
+// Compression mode (viflashdrv_cmp.c)
+VIFLASH_Result_t VIFLASH_CmpWrite(const uint8_t *buff, uint32_t sector, uint32_t count);
+VIFLASH_Result_t VIFLASH_CmpRead(uint8_t *buff, uint32_t sector, uint32_t count);
+
+// Digest table (viflashdrv_digest.c)
+VIFLASH_Result_t VIFLASH_DigestWrite(const uint8_t *buff, uint32_t sector, uint32_t count);
+/*!
+Leading and trailing sectors of a write whose digest is equal, as left out by VIFLASH_DigestWrite
+\param[out] first - first sector to write, relative to sector
+\param[out] last - sector behind the last one to write; first == last if nothing is written
+*/
+void VIFLASH_DigestTrim(const uint8_t *buff, uint32_t sector, uint32_t count,
+  uint32_t *first, uint32_t *last);
+/*!
+Take the digests of read sectors which are not known yet
+*/
+void VIFLASH_DigestLearn(const uint8_t *buff, uint32_t sector, uint32_t count);
+/*!
+Drop the digests of the FF-sectors overlapping a flash range
+*/
+void VIFLASH_DigestInvalidate(size_t address, uint32_t size);
+
+// Erased-state bitmap (viflashdrv_blank.c)
+/*!
+Follow a program (erased false: every touched FF-sector) or an erase
+(erased true: the FF-sectors inside the range)
+*/
+void VIFLASH_BlankMark(size_t address, uint32_t size, bool erased);
+/*!
+True if every FF-sector overlapping the range is known blank
+*/
+bool VIFLASH_BlankRange(size_t address, uint32_t size);
+void VIFLASH_BlankWritten(void);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // VIFLASHDRV_PRIVATE_H
\ No newline at end of file
@@ -0,0 +1,105 @@
+#ifndef VIFLASHDRV_QUEUE_H
+#define VIFLASHDRV_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "viflashdrv.h"
+
+// Most writes served by one read-modify-write
+#ifndef VIFLASH_QUEUE_MAX_MERGE
+#define VIFLASH_QUEUE_MAX_MERGE  8
+#endif
+// A waiting request is raised by one priority level every time it was passed this often
+#ifndef VIFLASH_QUEUE_MAX_PASS
+#define VIFLASH_QUEUE_MAX_PASS   16
+#endif
+
+typedef enum {
+  VIFLASH_PRIO_URGENT = 0,  /* served first, in submission order */
+  VIFLASH_PRIO_NORMAL,
+  VIFLASH_PRIO_BULK         /* e.g. background logging */
+} VIFLASH_Prio_t;
+
+typedef enum {
+  VIFLASH_REQ_READ = 0,
+  VIFLASH_REQ_WRITE
+} VIFLASH_ReqOp_t;
+
+typedef enum {
+  VIFLASH_REQ_IDLE = 0,
+  VIFLASH_REQ_QUEUED,
+  VIFLASH_REQ_DONE
+} VIFLASH_ReqState_t;
+
+/*!
+I/O request, the storage belongs to the caller until the request is done.
+op, prio, buff, sector, count and context are set by the caller.
+*/
+typedef struct VIFLASH_Request_s {
+  uint8_t op;                       /* VIFLASH_ReqOp_t */
+  uint8_t prio;                     /* VIFLASH_Prio_t */
+  void *buff;                       /* data to write / buffer to read to */
+  uint32_t sector;
+  uint32_t count;
+  void *context;                    /* free for the caller */
+
+  volatile uint8_t state;           /* VIFLASH_ReqState_t */
+  VIFLASH_Result_t result;          /* valid when done */
+  uint8_t passed;
+  uint32_t seq;
+  struct VIFLASH_Request_s *next;
+} VIFLASH_Request_t;
+
+/*!
+OS hooks, each may be NULL
+*/
+typedef struct {
+  void (*lock)(void);                         /* protect the queue, e.g. mutex or interrupt disable */
+  void (*unlock)(void);
+  void (*signalWorker)(void);                 /* a request was submitted */
+  void (*signalDone)(VIFLASH_Request_t *req); /* a request is done, called from the worker */
+} VIFLASH_QueueHooks_t;
+
+typedef struct {
+  uint32_t submitted;
+  uint32_t completed;
+  uint32_t merged;        /* writes served by the read-modify-write of another one */
+  uint32_t rmw;           /* read-modify-write passes */
+  uint32_t maxQueued;
+} VIFLASH_QueueStats_t;
+
+/*!
+Initialize the request queue. Tasks submit requests, one worker context serves
+them with VIFLASH_QueueProcess, so the tasks do not collide on the write lock.
+\param[in] hooks - OS hooks, NULL without OS
+*/
+bool VIFLASH_QueueInit(const VIFLASH_QueueHooks_t *hooks);
+
+/*!
+Queue a request
+\param[in] req - filled request
+\return VIFLASH_RESULT_OK if queued
+*/
+VIFLASH_Result_t VIFLASH_Submit(VIFLASH_Request_t *req);
+
+bool VIFLASH_IsDone(const VIFLASH_Request_t *req);
+
+/*!
+Serve queued requests, to be called from the worker context. Urgent requests
+go first, the others by priority in elevator order of the sector. Writes
+touching the same flash sector are written with one read-modify-write.
+Requests on overlapping sectors keep their order.
+\param[in] maxRequests - requests to serve, 0 until the queue is empty
+\return served requests
+*/
+uint32_t VIFLASH_QueueProcess(uint32_t maxRequests);
+
+void VIFLASH_QueueGetStats(VIFLASH_QueueStats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIFLASHDRV_QUEUE_H
@@ -0,0 +1,75 @@
+#ifndef VIFLASHDRV_TRACE_H
+#define VIFLASHDRV_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "viflashdrv.h"
+
+// Size of one encoded trace record [B]
+#define VIFLASH_TRACE_RECORD_SIZE 24
+// Value of the hash field of the start record
+#define VIFLASH_TRACE_MAGIC       0x54464956U /* "VIFT" */
+
+typedef enum {
+  VIFLASH_TRACE_START = 0,  /* first record: sector = FF-sector size, count = FF-sectors,
+                               duration = tick frequency [Hz], hash = VIFLASH_TRACE_MAGIC */
+  VIFLASH_TRACE_WRITE,
+  VIFLASH_TRACE_READ,
+  VIFLASH_TRACE_IOCTL       /* cmd = ioctl command */
+} VIFLASH_TraceOp_t;
+
+// Decoded trace record. Encoded little endian in the field order below.
+typedef struct {
+  uint8_t  op;         /* VIFLASH_TraceOp_t */
+  uint8_t  result;     /* VIFLASH_Result_t of the call */
+  uint8_t  cmd;        /* ioctl command */
+  uint8_t  flags;      /* VIFLASH_TRACE_FLAG_xxx */
+  uint32_t sector;     /* first FF-sector */
+  uint32_t count;      /* FF-sectors */
+  uint32_t timestamp;  /* tick at call entry */
+  uint32_t duration;   /* ticks spent in the call */
+  uint32_t hash;       /* FNV-1a of the written data */
+} VIFLASH_TraceRecord_t;
+
+#define VIFLASH_TRACE_FLAG_HASH   0x01  /* hash field is valid */
+#define VIFLASH_TRACE_FLAG_BLANK  0x02  /* written data is all 0xFF, set with the hash */
+
+/*!
+Receives each encoded record, e.g. to store it in RAM or send it over UART
+\param[in] record - VIFLASH_TRACE_RECORD_SIZE bytes
+\return false if the record was dropped
+*/
+typedef bool (*VIFLASH_TraceSink_t)(const uint8_t *record, uint32_t size);
+
+/*!
+Start capture of VIFLASH_Write, VIFLASH_Read and VIFLASH_Ioctl calls.
+The driver must be initialized, a start record is emitted immediately.
+\param[in] sinkCb - record receiver
+\param[in] tickCb - time source, may be NULL (timestamps are 0 then)
+\param[in] tickHz - frequency of tickCb
+\param[in] hashData - add a hash of the written data to write records
+*/
+bool VIFLASH_TraceStart(VIFLASH_TraceSink_t sinkCb, VIFLASH_GetTick_t tickCb,
+  uint32_t tickHz, bool hashData);
+
+/*!
+Stop capture
+\return number of records dropped by the sink
+*/
+uint32_t VIFLASH_TraceStop(void);
+
+void VIFLASH_TraceEncode(const VIFLASH_TraceRecord_t *record, uint8_t *buff);
+void VIFLASH_TraceDecode(const uint8_t *buff, VIFLASH_TraceRecord_t *record);
+
+/*!
+FNV-1a hash as used by the trace
+*/
+uint32_t VIFLASH_TraceHash(const uint8_t *buff, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIFLASHDRV_TRACE_H
@@ -1,316 +1,755 @@
-#include "viflashdrv_private.h"
-#include <stdlib.h>
-
-static Driver_t driver = {
-  NULL, /*programCb*/ NULL, /*unlockCb*/ NULL, /*lockCb*/
-  NULL, /*eraseSecCb*/ NULL, /*sectorToAddrCb*/ NULL, /*addrToSectorCb*/
-  NULL, /*sectorSizeCb*/ 0, /*startDiskAddress*/ 0, /*endDiskAddress*/
-  0, /*ffSectorSize*/ false, /*initialized*/ false /*writeProtected*/,
-  {0 /*stopFlashAddr*/, 0 /*stopFlashSector*/, 0 /*startFlashAddr*/, 0 /*startFlashSector*/, 
-   NULL /*currentFlashAddrPtr*/, NULL /*currentBufferPtr*/,NULL /*sectorBuffer*/},
-  NULL /*printfCb*/, 0 /*debugLvl*/
-};
-
-bool VIFLASH_InitDriver(VIFLASH_Program_t programCb,
-  VIFLASH_Unlock_t unlockCb, VIFLASH_Lock_t lockCb, VIFLASH_EraseSector_t eraseSecCb, 
-  VIFLASH_SectorToAddress_t sectorToAddrCb, VIFLASH_AddressToSector_t addrToSectorCb, 
-  VIFLASH_SectorSize_t sectorSizeCb,
-  size_t startDiskAddress, size_t endDiskAddress, uint32_t ffSectorSize) {
-
-  driver.initialized = false;
-  driver.printfCb = NULL;
-  driver.programCb = NULL;
-  driver.unlockCb = NULL;
-  driver.lockCb = NULL;
-  driver.eraseSecCb = NULL;
-  driver.sectorToAddrCb = NULL;
-  driver.addrToSectorCb = NULL;
-  driver.sectorSizeCb = NULL;
-  driver.startDiskAddress = 0;
-  driver.endDiskAddress = 0;
-  driver.ffSectorSize = 0;
-  
-  if((NULL == programCb) || (NULL == unlockCb) ||
-     (NULL == lockCb) || (NULL == eraseSecCb || 
-     (NULL == sectorToAddrCb) || (NULL == addrToSectorCb) ||
-     (NULL == sectorSizeCb) || (0 == startDiskAddress) || 
-     (0 == endDiskAddress) || 0 == ffSectorSize))
-    return false;
-  
-  driver.programCb = programCb;
-  driver.unlockCb = unlockCb;
-  driver.lockCb = lockCb;
-  driver.eraseSecCb = eraseSecCb;
-  driver.sectorToAddrCb = sectorToAddrCb;
-  driver.addrToSectorCb = addrToSectorCb;
-  driver.sectorSizeCb = sectorSizeCb;
-
-  driver.startDiskAddress = startDiskAddress;
-  driver.endDiskAddress = endDiskAddress;
-  driver.ffSectorSize = ffSectorSize;
-  driver.writeProtected = false;
-  driver.initialized = true;
-
-  return true;
-}
-
-VIFLASH_Result_t VIFLASH_Write(const uint8_t *buff, 
-  uint32_t sector, uint32_t count) {
-  if(!driver.initialized) {
-    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
-      driver.printfCb("ERROR: Driver not initialized\r\n");
-    return VIFLASH_RESULT_NOTRDY;
-  }
-  if(driver.writeProtected) {
-    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
-      driver.printfCb("ERROR: Write protected\r\n");
-    return VIFLASH_RESULT_WRPRT;
-  }
-  driver.wrtCtrl.stopFlashAddr = driver.startDiskAddress + (sector+count) * driver.ffSectorSize - 1;
-  driver.wrtCtrl.stopFlashSector = driver.addrToSectorCb(driver.wrtCtrl.stopFlashAddr);
-
-  if((NULL == buff) || (0 == count) || 
-     (driver.endDiskAddress <= driver.sectorToAddrCb(driver.wrtCtrl.stopFlashSector))) {
-    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
-      driver.printfCb("ERROR: Wrong parameters\r\n");
-    return VIFLASH_RESULT_PARERR;
-  }
-  driver.wrtCtrl.startFlashAddr = driver.startDiskAddress + sector * driver.ffSectorSize;
-  driver.wrtCtrl.startFlashSector = driver.addrToSectorCb(driver.wrtCtrl.startFlashAddr);
-
-  driver.writeProtected = true;
-  int8_t diskSectors = driver.wrtCtrl.stopFlashSector - driver.wrtCtrl.startFlashSector + 1;
-  if(0 >= diskSectors)
-    return VIFLASH_RESULT_ERROR;
-
-  driver.wrtCtrl.sectorBuffer = NULL;
-  uint32_t bytesWritten = 0;
-  driver.wrtCtrl.currentFlashAddrPtr = (uint8_t*)driver.sectorToAddrCb(driver.wrtCtrl.startFlashSector);
-  driver.wrtCtrl.currentBufferPtr = NULL;
-  
-  bool success = true;
-  // iterate trough each flash sector
-  for(int32_t i = 0; i < diskSectors; i++) {
-    int32_t currentSector = driver.wrtCtrl.startFlashSector + i;
-
-    //allocate buffer for current sector
-    uint32_t sectorSize = driver.sectorSizeCb(currentSector);
-    if(VIFLASH_DEBUG_LVL1 <=  driver.debugLvl && NULL != driver.printfCb)
-      driver.printfCb("Alloc memory for sector: %d; size: %d [B]\r\n", currentSector, sectorSize);
-    driver.wrtCtrl.sectorBuffer = (uint8_t*)malloc(sectorSize);
-    if(NULL == driver.wrtCtrl.sectorBuffer) {
-      if(VIFLASH_DEBUG_DISABLED < driver.debugLvl && NULL != driver.printfCb)
-        driver.printfCb("ERROR: malloc(%d) \r\n", sectorSize);
-      success = false;
-      break;
-    }
-    if(VIFLASH_DEBUG_LVL1 <= driver.debugLvl && 
-       NULL != driver.printfCb)
-      driver.printfCb("Memory allocated: 0x%08lX;\r\n", driver.wrtCtrl.sectorBuffer);
-
-    driver.wrtCtrl.currentBufferPtr = driver.wrtCtrl.sectorBuffer;
-    bool enableEraseSector = false;
-    bool enableWriteSector = false;
-    // prepare data in buffer
-    if(VIFLASH_DEBUG_LVL2 <= driver.debugLvl && NULL != driver.printfCb) {
-      driver.printfCb("Prepare data in buffer:\r\n");
-      driver.printfCb("  ");
-    }
-      
-    for(uint32_t j = 0; j < sectorSize; j++) {
-      // if cursor out of start address to write, copy conten of flash to buffer
-      if ((driver.wrtCtrl.currentFlashAddrPtr < (uint8_t*)driver.wrtCtrl.startFlashAddr) || 
-          (driver.wrtCtrl.currentFlashAddrPtr > (uint8_t*)driver.wrtCtrl.stopFlashAddr)) {
-        if(VIFLASH_DEBUG_LVL2 <= driver.debugLvl && NULL != driver.printfCb)
-          driver.printfCb("%02X ", *(driver.wrtCtrl.currentFlashAddrPtr));
-        *(driver.wrtCtrl.currentBufferPtr++) = *(driver.wrtCtrl.currentFlashAddrPtr);
-      } else // else copy from incomming buffer
-      if ((driver.wrtCtrl.currentFlashAddrPtr >= (uint8_t*)driver.wrtCtrl.startFlashAddr) && 
-          (driver.wrtCtrl.currentFlashAddrPtr <= (uint8_t*)driver.wrtCtrl.stopFlashAddr)) {
-        if((!enableEraseSector) && 
-           (0xFF != *driver.wrtCtrl.currentFlashAddrPtr) && 
-           (*(buff + bytesWritten) != *driver.wrtCtrl.currentFlashAddrPtr)) {
-            enableEraseSector = true;
-        }
-        if(!enableWriteSector)
-          enableWriteSector = true;
-        if(VIFLASH_DEBUG_LVL2 <= driver.debugLvl && NULL != driver.printfCb)
-          driver.printfCb("%02X ", *(buff + bytesWritten));
-        *(driver.wrtCtrl.currentBufferPtr++) = *(buff + bytesWritten++);
-      }
-      driver.wrtCtrl.currentFlashAddrPtr++;
-    }
-    if(VIFLASH_DEBUG_LVL2 < driver.debugLvl && NULL != driver.printfCb)
-      driver.printfCb("\r\n");
-
-    Status_t stat;
-    stat = driver.unlockCb();
-    if(STATUS_OK != stat) {
-      if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
-        driver.printfCb("ERROR: Unlock");
-      success = false;
-    }
-
-    if(success && enableEraseSector) {
-      // erase sectors on disk
-      VIFLASH_EraseInit_t eraseInit = {
-        /*TypeErase*/    TYPEERASE_SECTORS, 
-        /*Banks*/        FLASH_BANK_BOTH,
-        /*Sector*/       currentSector,
-        /*NbSectors*/    1,
-        /*VoltageRange*/ VOLTAGE_RANGE_3
-      };
-      uint32_t sectorError = 0;
-      if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb)
-        driver.printfCb("Erase sector %d\r\n", currentSector);
-      do {
-        stat = driver.eraseSecCb(&eraseInit, &sectorError);
-      } while(STATUS_BUSY == stat);
-      
-      if(STATUS_OK != stat || 0xFFFFFFFFU != sectorError) {
-        if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
-          driver.printfCb("ERROR: Erase sector %d\r\n", currentSector);
-        success = false;
-      }
-    }
-
-    if(success && enableWriteSector) {
-      size_t startSectorAddr = driver.sectorToAddrCb(currentSector);
-      uint32_t* currentBufferPtr = (uint32_t*)driver.wrtCtrl.sectorBuffer;
-
-      if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb) {
-        if(VIFLASH_DEBUG_LVL1 <= driver.debugLvl)
-          driver.printfCb("Write sector %d; Start sector address 0x%08lX; \
-Start write address 0x%08lX\r\n", currentSector, startSectorAddr, driver.wrtCtrl.startFlashAddr);
-        else if(VIFLASH_DEBUG_LVL1 > driver.debugLvl)
-          driver.printfCb("Write sector %d;\r\n", currentSector);
-      }
-
-      for(size_t word = startSectorAddr; word < startSectorAddr + sectorSize; word+=4) {
-        char written = 's';
-        if((0xFFFFFFFFU != *currentBufferPtr) && (*(uint32_t*)(word) != *currentBufferPtr)) {
-          do {
-            stat = driver.programCb(TYPEPROGRAM_WORD, word, *currentBufferPtr);
-          } while(STATUS_BUSY == stat);
-          if(STATUS_OK != stat) {
-            if(VIFLASH_DEBUG_ERROR < driver.debugLvl && NULL != driver.printfCb)
-              driver.printfCb("ERROR: Word write error at address 0x%08lX\r\n", word);
-            success = false;
-            break;
-          }
-          written = 'w';
-        }
-        if(VIFLASH_DEBUG_LVL2 < driver.debugLvl && NULL != driver.printfCb)
-          driver.printfCb("0x%08lX : 0x%08lX [%c]\r\n", word, (*currentBufferPtr), written);
-        currentBufferPtr++;
-      }
-    }
-
-    driver.lockCb();
-
-    free(driver.wrtCtrl.sectorBuffer);
-    driver.wrtCtrl.sectorBuffer = NULL;
-
-    if(!success)
-      break;
-  }
-
-  driver.writeProtected = false;
-  if(!success)
-    return VIFLASH_RESULT_ERROR;
-  return VIFLASH_RESULT_OK;
-}
-
-VIFLASH_Result_t VIFLASH_Read (uint8_t *buff, 
-  uint32_t sector, uint32_t count) {
-  if(!driver.initialized) {
-    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
-      driver.printfCb("ERROR: Driver not initialized\r\n");
-    return VIFLASH_RESULT_NOTRDY;
-  }
-  if(driver.writeProtected) {
-    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
-      driver.printfCb("ERROR: Write protected\r\n");
-    return VIFLASH_RESULT_NOTRDY;
-  }
-
-  size_t stopAddress = driver.startDiskAddress + (sector+count) * driver.ffSectorSize;
-
-  if((NULL == buff) || (0 == count) || (driver.endDiskAddress <= stopAddress))
-    return VIFLASH_RESULT_PARERR;
-
-  driver.writeProtected = true;
-  size_t startAddress = driver.startDiskAddress + sector * driver.ffSectorSize;
-
-  size_t* currentBuffAddr = (size_t*)buff;
-  if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb)
-      driver.printfCb("Start read from 0x%08lX, %ld bytes.\r\n", startAddress, stopAddress-startAddress);
-
-  while(startAddress < stopAddress) {
-    if(VIFLASH_DEBUG_LVL2 <= driver.debugLvl && NULL != driver.printfCb)
-      driver.printfCb("0x%08lX : 0x%08lX\r\n", startAddress, *(size_t*)(startAddress));
-    *(currentBuffAddr++) = *(size_t*)(startAddress);
-    startAddress+=4;
-  }
-
-  driver.writeProtected = false;
-  return VIFLASH_RESULT_OK;
-}
-
-VIFLASH_Result_t VIFLASH_Ioctl (uint8_t cmd, void *buff) {
-  if(!driver.initialized)
-    return VIFLASH_RESULT_NOTRDY;
-  
-  switch(cmd){
-    case VIFLASH_CTRL_SYNC: {
-      return VIFLASH_RESULT_OK;
-      break;
-    }
-    case VIFLASH_GET_SECTOR_COUNT: {
-      if(NULL == buff)
-        return VIFLASH_RESULT_PARERR;
-      uint32_t diskSizeBytes = driver.endDiskAddress - driver.startDiskAddress;
-      uint32_t diskSizeSectors = diskSizeBytes / driver.ffSectorSize;
-      if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb)
-          driver.printfCb("Disk size %ld [B]; FF-Sectors %ld\r\n", diskSizeBytes, diskSizeSectors);
-      *(uint32_t*)buff = diskSizeSectors;
-      return VIFLASH_RESULT_OK;
-      break;
-    }
-    case VIFLASH_GET_SECTOR_SIZE: {
-      if(NULL == buff)
-        return VIFLASH_RESULT_PARERR;
-      if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb)
-          driver.printfCb("FF-Sector size %ld\r\n", driver.ffSectorSize);
-      *(uint32_t*)buff = driver.ffSectorSize;
-      return VIFLASH_RESULT_OK;
-      break;
-    }
-    case VIFLASH_GET_BLOCK_SIZE: {
-      if(NULL == buff)
-        return VIFLASH_RESULT_PARERR;
-      if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb)
-          driver.printfCb("FF-Block size %ld\r\n", driver.sectorSizeCb(0) / driver.ffSectorSize);
-      *(uint32_t*)buff = driver.sectorSizeCb(0) / driver.ffSectorSize;
-      return VIFLASH_RESULT_OK;
-      break;
-    }
-    case VIFLASH_CTRL_TRIM: {
-      return VIFLASH_RESULT_OK;
-      break;
-    }
-  }
-  return VIFLASH_RESULT_PARERR;
-}
-
-bool VIFLASH_IsWriteProtected(void) {
-  return driver.writeProtected;
-}
-
-void VIFLASH_SetPrintfCb(VIFLASH_Printf_t printfCb) {
-  driver.printfCb = printfCb;
-}
-
-void VIFLASH_SetDebugLvl(VIFLASH_DebugLvl_t lvl) {
-  driver.debugLvl = lvl;
+#include "viflashdrv_private.h"
+#include <stdlib.h>
+#include <string.h>
+
+// widest copy on host builds, the target copies words
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define COPY_VECTOR_SIZE 16
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define COPY_VECTOR_SIZE 16
+#else
+#define COPY_VECTOR_SIZE sizeof(size_t)
+#endif
+
+static Driver_t driver = {
+  NULL, /*programCb*/ NULL, /*unlockCb*/ NULL, /*lockCb*/
+  NULL, /*eraseSecCb*/ NULL, /*sectorToAddrCb*/ NULL, /*addrToSectorCb*/
+  NULL, /*sectorSizeCb*/
+  {NULL /*readCb*/, NULL /*programCb*/, NULL /*eraseCb*/, NULL /*unitCb*/, NULL /*sectorCb*/,
+   NULL /*unlockCb*/, NULL /*lockCb*/, NULL /*context*/, false /*memoryMapped*/, 0 /*mapBase*/},
+  0, /*startDiskAddress*/ 0, /*endDiskAddress*/
+  0, /*ffSectorSize*/ false, /*initialized*/ false /*writeProtected*/,
+  {0 /*stopFlashAddr*/, 0 /*startFlashAddr*/, NULL /*sectorBuffer*/},
+  NULL /*printfCb*/, 0 /*debugLvl*/,
+  {NULL /*sinkCb*/, NULL /*tickCb*/, false /*hashData*/, 0 /*dropped*/},
+  0, /*cmpSectors*/
+  false, /*digest*/
+  false, /*blankMap*/
+  {16 /*programWordUs*/, 143000 /*eraseBaseUs*/, 6700 /*erasePerKbUs*/, 20 /*copyPerKbUs*/}
+};
+
+static const VIFLASH_CostModel_t defaultCostModel = {16, 143000, 6700, 20};
+
+static void resetDriver(void) {
+  driver.initialized = false;
+  driver.printfCb = NULL;
+  driver.programCb = NULL;
+  driver.unlockCb = NULL;
+  driver.lockCb = NULL;
+  driver.eraseSecCb = NULL;
+  driver.sectorToAddrCb = NULL;
+  driver.addrToSectorCb = NULL;
+  driver.sectorSizeCb = NULL;
+  driver.startDiskAddress = 0;
+  driver.endDiskAddress = 0;
+  driver.ffSectorSize = 0;
+  driver.cmpSectors = 0;
+  driver.digest = false;
+  driver.blankMap = false;
+  memset(&driver.backend, 0, sizeof(driver.backend));
+}
+
+static void initDisk(size_t startDiskAddress, size_t endDiskAddress, uint32_t ffSectorSize) {
+  driver.startDiskAddress = startDiskAddress;
+  driver.endDiskAddress = endDiskAddress;
+  driver.ffSectorSize = ffSectorSize;
+  driver.writeProtected = false;
+  driver.initialized = true;
+}
+
+bool VIFLASH_InitDriver(VIFLASH_Program_t programCb,
+  VIFLASH_Unlock_t unlockCb, VIFLASH_Lock_t lockCb, VIFLASH_EraseSector_t eraseSecCb, 
+  VIFLASH_SectorToAddress_t sectorToAddrCb, VIFLASH_AddressToSector_t addrToSectorCb, 
+  VIFLASH_SectorSize_t sectorSizeCb,
+  size_t startDiskAddress, size_t endDiskAddress, uint32_t ffSectorSize) {
+
+  resetDriver();
+  if((NULL == programCb) || (NULL == unlockCb) ||
+     (NULL == lockCb) || (NULL == eraseSecCb || 
+     (NULL == sectorToAddrCb) || (NULL == addrToSectorCb) ||
+     (NULL == sectorSizeCb) || (0 == startDiskAddress) || 
+     (0 == endDiskAddress) || 0 == ffSectorSize))
+    return false;
+  
+  driver.programCb = programCb;
+  driver.unlockCb = unlockCb;
+  driver.lockCb = lockCb;
+  driver.eraseSecCb = eraseSecCb;
+  driver.sectorToAddrCb = sectorToAddrCb;
+  driver.addrToSectorCb = addrToSectorCb;
+  driver.sectorSizeCb = sectorSizeCb;
+  VIFLASH_InternalBackend(&driver, &driver.backend);
+
+  initDisk(startDiskAddress, endDiskAddress, ffSectorSize);
+  return true;
+}
+
+bool VIFLASH_InitBackend(const VIFLASH_Backend_t *backend,
+  size_t startDiskAddress, size_t endDiskAddress, uint32_t ffSectorSize) {
+
+  resetDriver();
+  if((NULL == backend) || (NULL == backend->readCb) ||
+     (NULL == backend->programCb) || (NULL == backend->eraseCb) ||
+     (NULL == backend->unitCb) || (NULL == backend->sectorCb) ||
+     (endDiskAddress <= startDiskAddress) || (0 == ffSectorSize))
+    return false;
+
+  driver.backend = *backend;
+  initDisk(startDiskAddress, endDiskAddress, ffSectorSize);
+  return true;
+}
+
+uint32_t VIFLASH_DiskSectors(void) {
+  if(0 != driver.cmpSectors)
+    return driver.cmpSectors;
+  return (driver.endDiskAddress - driver.startDiskAddress) / driver.ffSectorSize;
+}
+
+static VIFLASH_Result_t writeSectors(const uint8_t *buff, 
+  uint32_t sector, uint32_t count) {
+  if(!driver.initialized) {
+    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
+      driver.printfCb("ERROR: Driver not initialized\r\n");
+    return VIFLASH_RESULT_NOTRDY;
+  }
+  if(driver.writeProtected) {
+    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
+      driver.printfCb("ERROR: Write protected\r\n");
+    return VIFLASH_RESULT_WRPRT;
+  }
+  if((NULL == buff) || (0 == count) || 
+     (VIFLASH_DiskSectors() < count) || (VIFLASH_DiskSectors() - count < sector)) {
+    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
+      driver.printfCb("ERROR: Wrong parameters\r\n");
+    return VIFLASH_RESULT_PARERR;
+  }
+
+  driver.writeProtected = true;
+  VIFLASH_Result_t res;
+  if(0 != driver.cmpSectors)
+    res = VIFLASH_CmpWrite(buff, sector, count);
+  else if(driver.digest)
+    res = VIFLASH_DigestWrite(buff, sector, count);
+  else
+    res = VIFLASH_WriteRange(buff, driver.startDiskAddress + sector * driver.ffSectorSize,
+      count * driver.ffSectorSize);
+  driver.writeProtected = false;
+  return res;
+}
+
+// last segment holding an address, later segments win
+static const uint8_t* segmentData(const VIFLASH_Segment_t *segments, uint32_t count, 
+  size_t address) {
+  for(uint32_t k = count; 0 < k--; ) {
+    if(address >= segments[k].address && 
+       address < segments[k].address + segments[k].size)
+      return segments[k].data + (address - segments[k].address);
+  }
+  return NULL;
+}
+
+// merge the segments into a word of the old content; true if the word has to be
+// programmed: it differs from flash, after an erase it is not blank
+static bool mergeWord(const VIFLASH_Segment_t *segments, uint32_t count,
+  size_t address, const uint8_t *old, bool erased, uint8_t *word) {
+  memcpy(word, old, 4);
+  for(uint32_t k = 0; k < 4; k++) {
+    const uint8_t *data = segmentData(segments, count, address + k);
+    if(NULL != data)
+      word[k] = *data;
+  }
+  uint32_t value;
+  memcpy(&value, word, sizeof(value));
+  return erased ? (0xFFFFFFFFU != value) : (0 != memcmp(word, old, 4));
+}
+
+// erase only if a bit has to change from 0 to 1
+static bool eraseNeeded(const VIFLASH_Segment_t *segments, uint32_t count,
+  size_t unitAddress, const uint8_t *old, uint32_t unitSize) {
+  for(uint32_t j = 0; j < unitSize; j++) {
+    const uint8_t *data = segmentData(segments, count, unitAddress + j);
+    if((NULL != data) && (0xFF != old[j]) && (*data != old[j]))
+      return true;
+  }
+  return false;
+}
+
+// any word of the unit which the segments change
+static bool unitChanged(const VIFLASH_Segment_t *segments, uint32_t count,
+  size_t unitAddress, const uint8_t *old, uint32_t unitSize) {
+  for(uint32_t i = 0; i < unitSize; i += 4) {
+    uint8_t word[4];
+    if(mergeWord(segments, count, unitAddress + i, old + i, false, word))
+      return true;
+  }
+  return false;
+}
+
+// merge the segments into the buffer word by word and program the runs of words
+// which differ from flash; after an erase every word which is not blank
+static bool programUnit(const VIFLASH_Segment_t *segments, uint32_t count,
+  size_t unitAddress, uint8_t *buffer, uint32_t unitSize, bool erased) {
+  uint32_t runStart = 0;
+  for(uint32_t i = 0; i <= unitSize; i += 4) {
+    bool program = false;
+    if(i < unitSize) {
+      uint8_t word[4];
+      program = mergeWord(segments, count, unitAddress + i, buffer + i, erased, word);
+      memcpy(buffer + i, word, sizeof(word));
+    }
+    if(program)
+      continue;
+    if(runStart < i && !VIFLASH_FlashProgram(unitAddress + runStart, buffer + runStart, i - runStart))
+      return false;
+    runStart = i + 4;
+  }
+  return true;
+}
+
+// word aligned range of the segments inside an erase unit, true if it is known blank
+static bool blankUnit(const VIFLASH_Segment_t *segments, uint32_t count,
+  size_t unitAddress, uint32_t unitSize, size_t *start, size_t *end) {
+  if(!driver.blankMap)
+    return false;
+  *start = unitAddress + unitSize;
+  *end = unitAddress;
+  for(uint32_t k = 0; k < count; k++) {
+    size_t first = (segments[k].address > unitAddress) ? segments[k].address : unitAddress;
+    size_t last = (segments[k].address + segments[k].size < unitAddress + unitSize) ?
+      segments[k].address + segments[k].size : unitAddress + unitSize;
+    if(first >= last)
+      continue;
+    if(!VIFLASH_BlankRange(first, last - first))
+      return false;
+    if(first < *start)
+      *start = first;
+    if(last > *end)
+      *end = last;
+  }
+  *start &= ~(size_t)3;
+  *end = (*end + 3) & ~(size_t)3;
+  return *start < *end;
+}
+
+// program the merged words of a blank range without reading it, runs of up to
+// 64 bytes are merged on the stack; with estimate the words are only counted
+static bool programBlank(const VIFLASH_Segment_t *segments, uint32_t count,
+  size_t start, size_t end, VIFLASH_Cost_t *estimate) {
+  static const uint8_t blankWord[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+  uint8_t run[64];
+  uint32_t runSize = 0;
+  size_t runStart = start;
+  for(size_t address = start; address <= end; address += 4) {
+    uint8_t word[4];
+    bool program = (address < end) && mergeWord(segments, count, address, blankWord, true, word);
+    if(program && NULL != estimate) {
+      estimate->words++;
+      continue;
+    }
+    if(program) {
+      if(0 == runSize)
+        runStart = address;
+      memcpy(run + runSize, word, sizeof(word));
+      runSize += sizeof(word);
+      if(sizeof(run) > runSize)
+        continue;
+    }
+    if(0 != runSize && !VIFLASH_FlashProgram(runStart, run, runSize))
+      return false;
+    runSize = 0;
+  }
+  return true;
+}
+
+// read-modify-write of one erase unit; with estimate only the counters are updated
+static bool writeUnit(const VIFLASH_Segment_t *segments, uint32_t count,
+  size_t unitAddress, uint32_t unitSize, VIFLASH_Cost_t *estimate) {
+  // known blank: no read, no erase decision
+  size_t blankStart, blankEnd;
+  if(blankUnit(segments, count, unitAddress, unitSize, &blankStart, &blankEnd)) {
+    if(NULL != estimate) {
+      estimate->units++;
+      return programBlank(segments, count, blankStart, blankEnd, estimate);
+    }
+    if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb)
+      driver.printfCb("Write blank range at 0x%08lX;\r\n", blankStart);
+    bool success = VIFLASH_FlashUnlock() && programBlank(segments, count, blankStart, blankEnd, NULL);
+    VIFLASH_FlashLock();
+    if(success)
+      VIFLASH_BlankWritten();
+    return success;
+  }
+
+  const uint8_t *old = NULL;
+  if(NULL != estimate && driver.backend.memoryMapped) {
+    // the dry run reads the mapped flash in place
+    old = VIFLASH_FlashMap(unitAddress, NULL, unitSize);
+  } else {
+    //allocate buffer for current sector
+    if(VIFLASH_DEBUG_LVL1 <=  driver.debugLvl && NULL != driver.printfCb)
+      driver.printfCb("Alloc memory for sector at 0x%08lX; size: %d [B]\r\n", unitAddress, unitSize);
+    driver.wrtCtrl.sectorBuffer = (uint8_t*)malloc(unitSize);
+    if(NULL == driver.wrtCtrl.sectorBuffer) {
+      if(VIFLASH_DEBUG_DISABLED < driver.debugLvl && NULL != driver.printfCb)
+        driver.printfCb("ERROR: malloc(%d) \r\n", unitSize);
+      return false;
+    }
+    if(VIFLASH_FlashRead(unitAddress, driver.wrtCtrl.sectorBuffer, unitSize))
+      old = driver.wrtCtrl.sectorBuffer;
+  }
+  uint8_t *buffer = driver.wrtCtrl.sectorBuffer;
+  bool success = (NULL != old);
+
+  bool enableEraseSector = success && eraseNeeded(segments, count, unitAddress, old, unitSize);
+  bool enableWriteSector = success && 
+    (enableEraseSector || unitChanged(segments, count, unitAddress, old, unitSize));
+
+  if(success && NULL != estimate) {
+    estimate->units++;
+    estimate->copyBytes += unitSize;
+    if(enableEraseSector) {
+      estimate->erases++;
+      estimate->eraseBytes += unitSize;
+    }
+    for(uint32_t i = 0; i < unitSize; i += 4) {
+      uint8_t word[4];
+      if(mergeWord(segments, count, unitAddress + i, old + i, enableEraseSector, word))
+        estimate->words++;
+    }
+  } else if(success && !enableWriteSector) {
+    if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb)
+      driver.printfCb("Skip sector at 0x%08lX, content is equal\r\n", unitAddress);
+  } else if(success) {
+    success = VIFLASH_FlashUnlock();
+    if(success && enableEraseSector) {
+      if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb)
+        driver.printfCb("Erase sector at 0x%08lX\r\n", unitAddress);
+      success = VIFLASH_FlashErase(unitAddress);
+    }
+    if(success) {
+      if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb)
+        driver.printfCb("Write sector at 0x%08lX;\r\n", unitAddress);
+      success = programUnit(segments, count, unitAddress, buffer, unitSize, enableEraseSector);
+    }
+    VIFLASH_FlashLock();
+    // an interrupted read-modify-write may have erased the neighbours too
+    if(!success)
+      VIFLASH_DigestInvalidate(unitAddress, unitSize);
+  }
+
+  free(driver.wrtCtrl.sectorBuffer);
+  driver.wrtCtrl.sectorBuffer = NULL;
+  return success;
+}
+
+// write the segments, or only count the work of the write if estimate is not NULL
+static VIFLASH_Result_t mergeSegments(const VIFLASH_Segment_t *segments, uint32_t count,
+  VIFLASH_Cost_t *estimate) {
+  if(0 == count)
+    return VIFLASH_RESULT_ERROR;
+  driver.wrtCtrl.startFlashAddr = segments[0].address;
+  driver.wrtCtrl.stopFlashAddr = segments[0].address + segments[0].size - 1;
+  for(uint32_t k = 1; k < count; k++) {
+    if(segments[k].address < driver.wrtCtrl.startFlashAddr)
+      driver.wrtCtrl.startFlashAddr = segments[k].address;
+    if(segments[k].address + segments[k].size - 1 > driver.wrtCtrl.stopFlashAddr)
+      driver.wrtCtrl.stopFlashAddr = segments[k].address + segments[k].size - 1;
+  }
+
+  bool success = true;
+  // iterate trough the erase units of the backend
+  size_t address = driver.wrtCtrl.startFlashAddr;
+  while(success && address <= driver.wrtCtrl.stopFlashAddr) {
+    size_t unitAddress = 0;
+    uint32_t unitSize = VIFLASH_FlashUnit(address, &unitAddress);
+    if(0 == unitSize || unitAddress > address) {
+      if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
+        driver.printfCb("ERROR: No erase sector at 0x%08lX\r\n", address);
+      success = false;
+      break;
+    }
+    address = unitAddress + unitSize;
+
+    // skip erase units between the segments
+    bool touched = false;
+    for(uint32_t k = 0; k < count && !touched; k++) {
+      touched = (segments[k].address < unitAddress + unitSize) &&
+                (segments[k].address + segments[k].size > unitAddress);
+    }
+    if(touched)
+      success = writeUnit(segments, count, unitAddress, unitSize, estimate);
+  }
+
+  if(!success)
+    return VIFLASH_RESULT_ERROR;
+  return VIFLASH_RESULT_OK;
+}
+
+VIFLASH_Result_t VIFLASH_WriteSegments(const VIFLASH_Segment_t *segments, uint32_t count) {
+  for(uint32_t k = 0; k < count; k++)
+    VIFLASH_DigestInvalidate(segments[k].address, segments[k].size);
+  return mergeSegments(segments, count, NULL);
+}
+
+// the digest of a written sector is kept up to date by the caller
+VIFLASH_Result_t VIFLASH_WriteRange(const uint8_t *buff, size_t address, uint32_t size) {
+  VIFLASH_Segment_t segment = {buff, address, size};
+  return mergeSegments(&segment, 1, NULL);
+}
+
+// modelled time of the counted work, 64 bit and saturated
+static uint32_t costTime(const VIFLASH_Cost_t *cost) {
+  const VIFLASH_CostModel_t *model = &driver.costModel;
+  uint64_t time = (uint64_t)cost->words * model->programWordUs +
+                  (uint64_t)cost->erases * model->eraseBaseUs +
+                  (uint64_t)cost->eraseBytes * model->erasePerKbUs / 1024 +
+                  (uint64_t)cost->copyBytes * model->copyPerKbUs / 1024;
+  return (UINT32_MAX < time) ? UINT32_MAX : (uint32_t)time;
+}
+
+VIFLASH_Result_t VIFLASH_EstimateWrite(const uint8_t *buff,
+  uint32_t sector, uint32_t count, VIFLASH_Cost_t *out) {
+  if(!driver.initialized) {
+    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
+      driver.printfCb("ERROR: Driver not initialized\r\n");
+    return VIFLASH_RESULT_NOTRDY;
+  }
+  if(driver.writeProtected) {
+    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
+      driver.printfCb("ERROR: Write protected\r\n");
+    return VIFLASH_RESULT_WRPRT;
+  }
+  if((NULL == buff) || (NULL == out) || (0 == count) || (0 != driver.cmpSectors) ||
+     (VIFLASH_DiskSectors() < count) || (VIFLASH_DiskSectors() - count < sector)) {
+    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
+      driver.printfCb("ERROR: Wrong parameters\r\n");
+    return VIFLASH_RESULT_PARERR;
+  }
+
+  memset(out, 0, sizeof(*out));
+  // the sectors VIFLASH_Write would leave out for their digest
+  uint32_t first = 0, last = count;
+  if(driver.digest)
+    VIFLASH_DigestTrim(buff, sector, count, &first, &last);
+  if(first == last)
+    return VIFLASH_RESULT_OK;
+  driver.writeProtected = true;
+  VIFLASH_Segment_t segment = {buff + first * driver.ffSectorSize,
+    driver.startDiskAddress + (sector + first) * driver.ffSectorSize,
+    (last - first) * driver.ffSectorSize};
+  VIFLASH_Result_t res = mergeSegments(&segment, 1, out);
+  driver.writeProtected = false;
+  out->timeUs = costTime(out);
+  return res;
+}
+
+void VIFLASH_SetCostModel(const VIFLASH_CostModel_t *model) {
+  driver.costModel = (NULL != model) ? *model : defaultCostModel;
+}
+
+/*!
+Copy from memory mapped flash to a buffer of any alignment: bytes up to an aligned
+destination, the widest loads with aligned stores in the middle, bytes of the tail
+*/
+static void copyFlash(uint8_t *dst, const uint8_t *src, uint32_t size) {
+  while(0 != size && 0 != ((uintptr_t)dst & (COPY_VECTOR_SIZE - 1))) {
+    *dst++ = *src++;
+    size--;
+  }
+#if defined(__SSE2__)
+  for(; 64 <= size; size -= 64, src += 64, dst += 64) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(src));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + 16));
+    __m128i c = _mm_loadu_si128((const __m128i*)(src + 32));
+    __m128i d = _mm_loadu_si128((const __m128i*)(src + 48));
+    _mm_store_si128((__m128i*)(dst), a);
+    _mm_store_si128((__m128i*)(dst + 16), b);
+    _mm_store_si128((__m128i*)(dst + 32), c);
+    _mm_store_si128((__m128i*)(dst + 48), d);
+  }
+  for(; 16 <= size; size -= 16, src += 16, dst += 16)
+    _mm_store_si128((__m128i*)dst, _mm_loadu_si128((const __m128i*)src));
+#elif defined(__ARM_NEON)
+  for(; 64 <= size; size -= 64, src += 64, dst += 64) {
+    uint8x16_t a = vld1q_u8(src);
+    uint8x16_t b = vld1q_u8(src + 16);
+    uint8x16_t c = vld1q_u8(src + 32);
+    uint8x16_t d = vld1q_u8(src + 48);
+    vst1q_u8(dst, a);
+    vst1q_u8(dst + 16, b);
+    vst1q_u8(dst + 32, c);
+    vst1q_u8(dst + 48, d);
+  }
+  for(; 16 <= size; size -= 16, src += 16, dst += 16)
+    vst1q_u8(dst, vld1q_u8(src));
+#endif
+  // fixed size memcpy compiles to a single (unaligned) load and store
+  for(; 4 * sizeof(size_t) <= size; size -= 4 * sizeof(size_t)) {
+    size_t a, b, c, d;
+    memcpy(&a, src, sizeof(size_t));
+    memcpy(&b, src + sizeof(size_t), sizeof(size_t));
+    memcpy(&c, src + 2 * sizeof(size_t), sizeof(size_t));
+    memcpy(&d, src + 3 * sizeof(size_t), sizeof(size_t));
+    memcpy(dst, &a, sizeof(size_t));
+    memcpy(dst + sizeof(size_t), &b, sizeof(size_t));
+    memcpy(dst + 2 * sizeof(size_t), &c, sizeof(size_t));
+    memcpy(dst + 3 * sizeof(size_t), &d, sizeof(size_t));
+    src += 4 * sizeof(size_t);
+    dst += 4 * sizeof(size_t);
+  }
+  for(; sizeof(size_t) <= size; size -= sizeof(size_t)) {
+    size_t a;
+    memcpy(&a, src, sizeof(size_t));
+    memcpy(dst, &a, sizeof(size_t));
+    src += sizeof(size_t);
+    dst += sizeof(size_t);
+  }
+  while(0 != size--)
+    *dst++ = *src++;
+}
+
+static VIFLASH_Result_t readSectors(uint8_t *buff, 
+  uint32_t sector, uint32_t count) {
+  if(!driver.initialized) {
+    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
+      driver.printfCb("ERROR: Driver not initialized\r\n");
+    return VIFLASH_RESULT_NOTRDY;
+  }
+  if(driver.writeProtected) {
+    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
+      driver.printfCb("ERROR: Write protected\r\n");
+    return VIFLASH_RESULT_NOTRDY;
+  }
+
+  if((NULL == buff) || (0 == count) || 
+     (VIFLASH_DiskSectors() < count) || (VIFLASH_DiskSectors() - count < sector))
+    return VIFLASH_RESULT_PARERR;
+
+  driver.writeProtected = true;
+  if(0 != driver.cmpSectors) {
+    VIFLASH_Result_t res = VIFLASH_CmpRead(buff, sector, count);
+    driver.writeProtected = false;
+    return res;
+  }
+
+  size_t startAddress = driver.startDiskAddress + sector * driver.ffSectorSize;
+  uint32_t size = count * driver.ffSectorSize;
+  if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb)
+      driver.printfCb("Start read from 0x%08lX, %ld bytes.\r\n", startAddress, size);
+
+  bool success = true;
+  if(driver.backend.memoryMapped)
+    copyFlash(buff, (const uint8_t*)(driver.backend.mapBase + startAddress), size);
+  else
+    success = driver.backend.readCb(driver.backend.context, startAddress, buff, size);
+  if(success && driver.digest)
+    VIFLASH_DigestLearn(buff, sector, count);
+
+  if(VIFLASH_DEBUG_LVL2 <= driver.debugLvl && NULL != driver.printfCb) {
+    for(uint32_t i = 0; i + 4 <= size; i += 4) {
+      uint32_t word;
+      memcpy(&word, buff + i, sizeof(word));
+      driver.printfCb("0x%08lX : 0x%08lX\r\n", startAddress + i, word);
+    }
+  }
+
+  driver.writeProtected = false;
+  if(!success) {
+    if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
+      driver.printfCb("ERROR: Read from 0x%08lX\r\n", startAddress);
+    return VIFLASH_RESULT_ERROR;
+  }
+  return VIFLASH_RESULT_OK;
+}
+
+static VIFLASH_Result_t controlDisk(uint8_t cmd, void *buff) {
+  if(!driver.initialized)
+    return VIFLASH_RESULT_NOTRDY;
+  
+  switch(cmd){
+    case VIFLASH_CTRL_SYNC: {
+      return VIFLASH_RESULT_OK;
+      break;
+    }
+    case VIFLASH_GET_SECTOR_COUNT: {
+      if(NULL == buff)
+        return VIFLASH_RESULT_PARERR;
+      uint32_t diskSizeBytes = driver.endDiskAddress - driver.startDiskAddress;
+      uint32_t diskSizeSectors = VIFLASH_DiskSectors();
+      if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb)
+          driver.printfCb("Disk size %ld [B]; FF-Sectors %ld\r\n", diskSizeBytes, diskSizeSectors);
+      *(uint32_t*)buff = diskSizeSectors;
+      return VIFLASH_RESULT_OK;
+      break;
+    }
+    case VIFLASH_GET_SECTOR_SIZE: {
+      if(NULL == buff)
+        return VIFLASH_RESULT_PARERR;
+      if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb)
+          driver.printfCb("FF-Sector size %ld\r\n", driver.ffSectorSize);
+      *(uint32_t*)buff = driver.ffSectorSize;
+      return VIFLASH_RESULT_OK;
+      break;
+    }
+    case VIFLASH_GET_BLOCK_SIZE: {
+      if(NULL == buff)
+        return VIFLASH_RESULT_PARERR;
+      // records are appended wherever the sector lands, no alignment helps
+      if(0 != driver.cmpSectors) {
+        *(uint32_t*)buff = 1;
+        return VIFLASH_RESULT_OK;
+      }
+      // smallest erase sector of the disk window, not of the whole flash
+      uint32_t diskSizeSectors = (driver.endDiskAddress - driver.startDiskAddress) / driver.ffSectorSize;
+      uint32_t blockSize = 0;
+      for(uint32_t ffSector = 0; ffSector < diskSizeSectors; ) {
+        uint32_t unitStart = 0, unitEnd = 0;
+        uint32_t unitSize = VIFLASH_EraseUnit(ffSector, &unitStart, &unitEnd) / driver.ffSectorSize;
+        if(0 == blockSize || unitSize < blockSize)
+          blockSize = unitSize;
+        ffSector = unitEnd;
+      }
+      if(0 == blockSize)
+        blockSize = 1;
+      if(VIFLASH_DEBUG_INFO <= driver.debugLvl && NULL != driver.printfCb)
+          driver.printfCb("FF-Block size %ld\r\n", blockSize);
+      *(uint32_t*)buff = blockSize;
+      return VIFLASH_RESULT_OK;
+      break;
+    }
+    case VIFLASH_CTRL_TRIM: {
+      return VIFLASH_RESULT_OK;
+      break;
+    }
+  }
+  return VIFLASH_RESULT_PARERR;
+}
+
+VIFLASH_Result_t VIFLASH_Write(const uint8_t *buff, 
+  uint32_t sector, uint32_t count) {
+  if(NULL == driver.trace.sinkCb)
+    return writeSectors(buff, sector, count);
+  uint32_t startTick = VIFLASH_TraceTick();
+  VIFLASH_Result_t res = writeSectors(buff, sector, count);
+  VIFLASH_TraceCall(VIFLASH_TRACE_WRITE, 0, sector, count, buff, res, startTick);
+  return res;
+}
+
+VIFLASH_Result_t VIFLASH_Read(uint8_t *buff, 
+  uint32_t sector, uint32_t count) {
+  if(NULL == driver.trace.sinkCb)
+    return readSectors(buff, sector, count);
+  uint32_t startTick = VIFLASH_TraceTick();
+  VIFLASH_Result_t res = readSectors(buff, sector, count);
+  VIFLASH_TraceCall(VIFLASH_TRACE_READ, 0, sector, count, NULL, res, startTick);
+  return res;
+}
+
+VIFLASH_Result_t VIFLASH_Ioctl(uint8_t cmd, void *buff) {
+  if(NULL == driver.trace.sinkCb)
+    return controlDisk(cmd, buff);
+  uint32_t startTick = VIFLASH_TraceTick();
+  VIFLASH_Result_t res = controlDisk(cmd, buff);
+  VIFLASH_TraceCall(VIFLASH_TRACE_IOCTL, cmd, 0, 0, NULL, res, startTick);
+  return res;
+}
+
+uint32_t VIFLASH_EraseUnit(uint32_t ffSector, uint32_t *unitStart, uint32_t *unitEnd) {
+  size_t address = driver.startDiskAddress + ffSector * driver.ffSectorSize;
+  size_t sectorAddress = address;
+  uint32_t sectorSize = VIFLASH_FlashUnit(address, &sectorAddress);
+  uint32_t diskSizeSectors = (driver.endDiskAddress - driver.startDiskAddress) / driver.ffSectorSize;
+
+  *unitStart = (sectorAddress <= driver.startDiskAddress) ? 0 :
+    (sectorAddress - driver.startDiskAddress) / driver.ffSectorSize;
+  *unitEnd = (sectorAddress + sectorSize - driver.startDiskAddress) / driver.ffSectorSize;
+  if(*unitEnd <= ffSector)
+    *unitEnd = ffSector + 1;
+  if(*unitEnd > diskSizeSectors)
+    *unitEnd = diskSizeSectors;
+  return sectorSize;
+}
+
+bool VIFLASH_FlashRead(size_t address, uint8_t *buff, uint32_t size) {
+  if(driver.backend.memoryMapped) {
+    memcpy(buff, (const void*)(driver.backend.mapBase + address), size);
+    return true;
+  }
+  return driver.backend.readCb(driver.backend.context, address, buff, size);
+}
+
+const uint8_t* VIFLASH_FlashMap(size_t address, uint8_t *scratch, uint32_t size) {
+  if(driver.backend.memoryMapped)
+    return (const uint8_t*)(driver.backend.mapBase + address);
+  if(NULL == scratch || !driver.backend.readCb(driver.backend.context, address, scratch, size))
+    return NULL;
+  return scratch;
+}
+
+bool VIFLASH_FlashUnlock(void) {
+  return (NULL == driver.backend.unlockCb) || driver.backend.unlockCb(driver.backend.context);
+}
+
+void VIFLASH_FlashLock(void) {
+  if(NULL != driver.backend.lockCb)
+    driver.backend.lockCb(driver.backend.context);
+}
+
+bool VIFLASH_FlashProgram(size_t address, const uint8_t *data, uint32_t size) {
+  VIFLASH_BlankMark(address, size, false);
+  if(driver.backend.programCb(driver.backend.context, address, data, size))
+    return true;
+  if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
+    driver.printfCb("ERROR: Program at 0x%08lX\r\n", address);
+  return false;
+}
+
+bool VIFLASH_FlashErase(size_t unitAddress) {
+  bool success = driver.backend.eraseCb(driver.backend.context, unitAddress);
+  if(driver.blankMap) {
+    // a failed erase leaves the unit in an unknown state
+    size_t unitStart = unitAddress;
+    uint32_t unitSize = VIFLASH_FlashUnit(unitAddress, &unitStart);
+    VIFLASH_BlankMark(unitStart, unitSize, success);
+  }
+  if(success)
+    return true;
+  if(VIFLASH_DEBUG_ERROR <= driver.debugLvl && NULL != driver.printfCb)
+    driver.printfCb("ERROR: Erase at 0x%08lX\r\n", unitAddress);
+  return false;
+}
+
+uint32_t VIFLASH_FlashUnit(size_t address, size_t *unitAddress) {
+  return driver.backend.unitCb(driver.backend.context, address, unitAddress);
+}
+
+Driver_t* VIFLASH_GetDriver(void) {
+  return &driver;
+}
+
+bool VIFLASH_IsWriteProtected(void) {
+  return driver.writeProtected;
+}
+
+uint32_t VIFLASH_Crc32(uint32_t crc, const uint8_t *buff, uint32_t size) {
+  static const uint32_t table[16] = {
+    0x00000000U, 0x1DB71064U, 0x3B6E20C8U, 0x26D930ACU, 0x76DC4190U, 0x6B6B51F4U, 0x4DB26158U, 0x5005713CU,
+    0xEDB88320U, 0xF00F9344U, 0xD6D6A3E8U, 0xCB61B38CU, 0x9B64C2B0U, 0x86D3D2D4U, 0xA00AE278U, 0xBDBDF21CU
+  };
+  crc = ~crc;
+  for(uint32_t i = 0; i < size; i++) {
+    crc = (crc >> 4) ^ table[(crc ^ buff[i]) & 0x0F];
+    crc = (crc >> 4) ^ table[(crc ^ (buff[i] >> 4)) & 0x0F];
+  }
+  return ~crc;
+}
+
+void VIFLASH_SetPrintfCb(VIFLASH_Printf_t printfCb) {
+  driver.printfCb = printfCb;
+}
+
+void VIFLASH_SetDebugLvl(VIFLASH_DebugLvl_t lvl) {
+  driver.debugLvl = lvl;
 }
\ No newline at end of file
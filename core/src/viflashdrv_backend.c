@@ -0,0 +1,262 @@
+#include "viflashdrv_backend.h"
+#include "viflashdrv_private.h"
+#include <string.h>
+
+#define NOR_CMD_WRITE_ENABLE  0x06U
+#define NOR_CMD_READ_STATUS   0x05U
+#define NOR_CMD_READ          0x03U
+#define NOR_CMD_PAGE_PROGRAM  0x02U
+#define NOR_CMD_SECTOR_ERASE  0x20U
+#define NOR_STATUS_BUSY       0x01U
+
+static bool isBlank(const uint8_t *data, uint32_t size) {
+  for(uint32_t i = 0; i < size; i++) {
+    if(0xFF != data[i])
+      return false;
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------ internal flash
+
+static bool internalRead(__attribute__((unused)) void *context, size_t address,
+  uint8_t *buff, uint32_t size) {
+  memcpy(buff, (const void*)address, size);
+  return true;
+}
+
+static bool internalUnlock(void *context) {
+  Driver_t *drv = (Driver_t*)context;
+  if(STATUS_OK == (Status_t)drv->unlockCb())
+    return true;
+  if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+    drv->printfCb("ERROR: Unlock\r\n");
+  return false;
+}
+
+static bool internalLock(void *context) {
+  Driver_t *drv = (Driver_t*)context;
+  return STATUS_OK == (Status_t)drv->lockCb();
+}
+
+static bool internalProgram(void *context, size_t address, const uint8_t *data, uint32_t size) {
+  Driver_t *drv = (Driver_t*)context;
+  Status_t stat;
+  bool success = true;
+  for(uint32_t i = 0; success && i < size; i += 4) {
+    uint32_t word = 0xFFFFFFFFU;
+    memcpy(&word, data + i, (size - i < 4) ? size - i : 4);
+    if(0xFFFFFFFFU == word)
+      continue;
+    do {
+      stat = drv->programCb(TYPEPROGRAM_WORD, address + i, word);
+    } while(STATUS_BUSY == stat);
+    if(STATUS_OK != stat) {
+      if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+        drv->printfCb("ERROR: Word write error at address 0x%08lX\r\n", address + i);
+      success = false;
+    }
+    if(VIFLASH_DEBUG_LVL2 < drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("0x%08lX : 0x%08lX [w]\r\n", address + i, word);
+  }
+  return success;
+}
+
+static bool internalErase(void *context, size_t unitAddress) {
+  Driver_t *drv = (Driver_t*)context;
+  int8_t sector = drv->addrToSectorCb(unitAddress);
+  VIFLASH_EraseInit_t eraseInit = {
+    /*TypeErase*/    TYPEERASE_SECTORS,
+    /*Banks*/        FLASH_BANK_BOTH,
+    /*Sector*/       sector,
+    /*NbSectors*/    1,
+    /*VoltageRange*/ VOLTAGE_RANGE_3
+  };
+  uint32_t sectorError = 0;
+  Status_t stat;
+  do {
+    stat = drv->eraseSecCb(&eraseInit, &sectorError);
+  } while(STATUS_BUSY == stat);
+  if(STATUS_OK != stat || 0xFFFFFFFFU != sectorError) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: Erase sector %d\r\n", sector);
+    return false;
+  }
+  return true;
+}
+
+static uint32_t internalUnit(void *context, size_t address, size_t *unitAddress) {
+  Driver_t *drv = (Driver_t*)context;
+  int8_t sector = drv->addrToSectorCb(address);
+  if(0 > sector)
+    return 0;
+  int32_t size = drv->sectorSizeCb(sector);
+  *unitAddress = drv->sectorToAddrCb(sector);
+  return (0 < size) ? (uint32_t)size : 0;
+}
+
+static uint32_t internalSector(void *context, uint32_t number, size_t *address) {
+  Driver_t *drv = (Driver_t*)context;
+  int32_t size = drv->sectorSizeCb((uint8_t)number);
+  *address = drv->sectorToAddrCb((uint8_t)number);
+  return (0 < size) ? (uint32_t)size : 0;
+}
+
+void VIFLASH_InternalBackend(Driver_t *drv, VIFLASH_Backend_t *backend) {
+  backend->readCb = internalRead;
+  backend->programCb = internalProgram;
+  backend->eraseCb = internalErase;
+  backend->unitCb = internalUnit;
+  backend->sectorCb = internalSector;
+  backend->unlockCb = internalUnlock;
+  backend->lockCb = internalLock;
+  backend->context = drv;
+  backend->memoryMapped = true;
+  backend->mapBase = 0;
+}
+
+// ------------------------------------------------------------------------ SPI NOR
+
+static bool norCommand(VIFLASH_SpiNor_t *nor, uint8_t opcode, const size_t *address,
+  const uint8_t *tx, uint8_t *rx, uint32_t size) {
+  uint8_t cmd[5] = {opcode};
+  uint32_t cmdSize = 1;
+  for(uint32_t i = (NULL != address) ? nor->addressBytes : 0; 0 < i; i--)
+    cmd[cmdSize++] = (uint8_t)(*address >> (8 * (i - 1)));
+  return nor->transferCb(nor->context, cmd, cmdSize, tx, rx, size);
+}
+
+static bool norWait(VIFLASH_SpiNor_t *nor) {
+  uint8_t status = 0;
+  do {
+    if(!norCommand(nor, NOR_CMD_READ_STATUS, NULL, NULL, &status, 1))
+      return false;
+  } while(status & NOR_STATUS_BUSY);
+  return true;
+}
+
+static bool norRead(void *context, size_t address, uint8_t *buff, uint32_t size) {
+  return norCommand((VIFLASH_SpiNor_t*)context, NOR_CMD_READ, &address, NULL, buff, size);
+}
+
+static bool norProgram(void *context, size_t address, const uint8_t *data, uint32_t size) {
+  VIFLASH_SpiNor_t *nor = (VIFLASH_SpiNor_t*)context;
+  while(0 < size) {
+    // a page program wraps at the page end
+    uint32_t chunk = nor->pageSize - (uint32_t)(address & (nor->pageSize - 1));
+    if(chunk > size)
+      chunk = size;
+    if(!isBlank(data, chunk)) {
+      if(!norCommand(nor, NOR_CMD_WRITE_ENABLE, NULL, NULL, NULL, 0) ||
+         !norCommand(nor, NOR_CMD_PAGE_PROGRAM, &address, data, NULL, chunk) ||
+         !norWait(nor))
+        return false;
+    }
+    address += chunk;
+    data += chunk;
+    size -= chunk;
+  }
+  return true;
+}
+
+static bool norErase(void *context, size_t unitAddress) {
+  VIFLASH_SpiNor_t *nor = (VIFLASH_SpiNor_t*)context;
+  return norCommand(nor, NOR_CMD_WRITE_ENABLE, NULL, NULL, NULL, 0) &&
+         norCommand(nor, NOR_CMD_SECTOR_ERASE, &unitAddress, NULL, NULL, 0) &&
+         norWait(nor);
+}
+
+static uint32_t norUnit(void *context, size_t address, size_t *unitAddress) {
+  VIFLASH_SpiNor_t *nor = (VIFLASH_SpiNor_t*)context;
+  if(address >= nor->size)
+    return 0;
+  *unitAddress = address & ~(size_t)(nor->eraseSize - 1);
+  return nor->eraseSize;
+}
+
+static uint32_t norSector(void *context, uint32_t number, size_t *address) {
+  VIFLASH_SpiNor_t *nor = (VIFLASH_SpiNor_t*)context;
+  if(number >= nor->size / nor->eraseSize)
+    return 0;
+  *address = (size_t)number * nor->eraseSize;
+  return nor->eraseSize;
+}
+
+bool VIFLASH_SpiNorBackend(VIFLASH_SpiNor_t *nor, VIFLASH_Backend_t *backend) {
+  if(NULL == nor || NULL == backend || NULL == nor->transferCb ||
+     (3 != nor->addressBytes && 4 != nor->addressBytes) ||
+     0 == nor->pageSize || 0 != (nor->pageSize & (nor->pageSize - 1)) ||
+     0 == nor->eraseSize || 0 != (nor->eraseSize & (nor->eraseSize - 1)) ||
+     0 != nor->eraseSize % nor->pageSize || 0 != nor->size % nor->eraseSize)
+    return false;
+  backend->readCb = norRead;
+  backend->programCb = norProgram;
+  backend->eraseCb = norErase;
+  backend->unitCb = norUnit;
+  backend->sectorCb = norSector;
+  backend->unlockCb = NULL;
+  backend->lockCb = NULL;
+  backend->context = nor;
+  backend->memoryMapped = false;
+  backend->mapBase = 0;
+  return true;
+}
+
+// ------------------------------------------------------------------------ RAM disk
+
+static bool ramRead(void *context, size_t address, uint8_t *buff, uint32_t size) {
+  VIFLASH_RamDisk_t *ram = (VIFLASH_RamDisk_t*)context;
+  if(address > ram->size || ram->size - address < size)
+    return false;
+  memcpy(buff, ram->memory + address, size);
+  return true;
+}
+
+static bool ramProgram(void *context, size_t address, const uint8_t *data, uint32_t size) {
+  VIFLASH_RamDisk_t *ram = (VIFLASH_RamDisk_t*)context;
+  if(address > ram->size || ram->size - address < size)
+    return false;
+  memcpy(ram->memory + address, data, size);
+  return true;
+}
+
+static bool ramErase(void *context, size_t unitAddress) {
+  VIFLASH_RamDisk_t *ram = (VIFLASH_RamDisk_t*)context;
+  if(unitAddress >= ram->size)
+    return false;
+  memset(ram->memory + unitAddress, 0xFF, ram->eraseSize);
+  return true;
+}
+
+static uint32_t ramUnit(void *context, size_t address, size_t *unitAddress) {
+  VIFLASH_RamDisk_t *ram = (VIFLASH_RamDisk_t*)context;
+  if(address >= ram->size)
+    return 0;
+  *unitAddress = address - address % ram->eraseSize;
+  return ram->eraseSize;
+}
+
+static uint32_t ramSector(void *context, uint32_t number, size_t *address) {
+  VIFLASH_RamDisk_t *ram = (VIFLASH_RamDisk_t*)context;
+  if(number >= ram->size / ram->eraseSize)
+    return 0;
+  *address = (size_t)number * ram->eraseSize;
+  return ram->eraseSize;
+}
+
+bool VIFLASH_RamBackend(VIFLASH_RamDisk_t *ram, VIFLASH_Backend_t *backend) {
+  if(NULL == ram || NULL == backend || NULL == ram->memory ||
+     0 == ram->eraseSize || 0 != ram->eraseSize % 4 || 0 != ram->size % ram->eraseSize)
+    return false;
+  backend->readCb = ramRead;
+  backend->programCb = ramProgram;
+  backend->eraseCb = ramErase;
+  backend->unitCb = ramUnit;
+  backend->sectorCb = ramSector;
+  backend->unlockCb = NULL;
+  backend->lockCb = NULL;
+  backend->context = ram;
+  backend->memoryMapped = true;
+  backend->mapBase = (size_t)ram->memory;
+  return true;
+}
@@ -0,0 +1,132 @@
+#include "viflashdrv_blank.h"
+#include "viflashdrv_private.h"
+#include <string.h>
+
+typedef struct {
+  uint32_t *bitmap;    /* bit set: FF sector known blank */
+  uint32_t sectors;
+  VIFLASH_BlankStats_t stats;
+}Blank_t;
+
+static Blank_t blank;
+
+// words at once, four loads per test of the accumulated value
+static bool isBlank(const uint8_t *data, uint32_t size) {
+  uint32_t i = 0;
+  for(; i + 4 * sizeof(size_t) <= size; i += 4 * sizeof(size_t)) {
+    size_t a, b, c, d;
+    memcpy(&a, data + i, sizeof(size_t));
+    memcpy(&b, data + i + sizeof(size_t), sizeof(size_t));
+    memcpy(&c, data + i + 2 * sizeof(size_t), sizeof(size_t));
+    memcpy(&d, data + i + 3 * sizeof(size_t), sizeof(size_t));
+    if(~(size_t)0 != (a & b & c & d))
+      return false;
+  }
+  for(; i < size; i++) {
+    if(0xFF != data[i])
+      return false;
+  }
+  return true;
+}
+
+static bool sectorBlank(uint32_t sector) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  size_t address = drv->startDiskAddress + (size_t)sector * drv->ffSectorSize;
+  if(drv->backend.memoryMapped)
+    return isBlank(VIFLASH_FlashMap(address, NULL, drv->ffSectorSize), drv->ffSectorSize);
+  // read through the backend in pieces
+  uint8_t scratch[64] __attribute__((aligned(sizeof(size_t))));
+  for(uint32_t offset = 0; offset < drv->ffSectorSize; offset += sizeof(scratch)) {
+    uint32_t chunk = (drv->ffSectorSize - offset < sizeof(scratch)) ?
+      drv->ffSectorSize - offset : sizeof(scratch);
+    if(NULL == VIFLASH_FlashMap(address + offset, scratch, chunk) || !isBlank(scratch, chunk))
+      return false;
+  }
+  return true;
+}
+
+static bool isKnownBlank(uint32_t sector) {
+  return 0 != (blank.bitmap[sector / 32] & (1U << (sector % 32)));
+}
+
+void VIFLASH_BlankMark(size_t address, uint32_t size, bool erased) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  if(!drv->blankMap || 0 == size || address >= drv->endDiskAddress ||
+     address + size <= drv->startDiskAddress)
+    return;
+  size_t start = (address > drv->startDiskAddress) ? address - drv->startDiskAddress : 0;
+  size_t end = ((address + size < drv->endDiskAddress) ? address + size : drv->endDiskAddress) -
+    drv->startDiskAddress;
+  // erased: the sectors inside the range, programmed: every sector it touches
+  uint32_t first = erased ? (start + drv->ffSectorSize - 1) / drv->ffSectorSize : start / drv->ffSectorSize;
+  uint32_t last = erased ? end / drv->ffSectorSize : (end + drv->ffSectorSize - 1) / drv->ffSectorSize;
+  if(last > blank.sectors)
+    last = blank.sectors;
+  for(uint32_t sector = first; sector < last; sector++) {
+    if(erased)
+      blank.bitmap[sector / 32] |= 1U << (sector % 32);
+    else
+      blank.bitmap[sector / 32] &= ~(1U << (sector % 32));
+  }
+}
+
+bool VIFLASH_BlankRange(size_t address, uint32_t size) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  if(!drv->blankMap || 0 == size || address < drv->startDiskAddress ||
+     address + size > drv->endDiskAddress)
+    return false;
+  uint32_t last = (address + size - drv->startDiskAddress + drv->ffSectorSize - 1) / drv->ffSectorSize;
+  for(uint32_t sector = (address - drv->startDiskAddress) / drv->ffSectorSize; sector < last; sector++) {
+    if(sector >= blank.sectors || !isKnownBlank(sector))
+      return false;
+  }
+  return true;
+}
+
+void VIFLASH_BlankWritten(void) {
+  blank.stats.blankWrites++;
+}
+
+bool VIFLASH_EnableBlankMap(uint32_t *bitmap, uint32_t words, VIFLASH_GetTick_t tickCb) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  if(!drv->initialized || drv->writeProtected)
+    return false;
+
+  drv->blankMap = false;
+  memset(&blank, 0, sizeof(blank));
+  if(NULL == bitmap)
+    return true;
+
+  // programs are word wide, so FF sectors must not share a word
+  uint32_t sectors = (drv->endDiskAddress - drv->startDiskAddress) / drv->ffSectorSize;
+  if((0 != drv->ffSectorSize % 4) || (0 != drv->startDiskAddress % 4) ||
+     (VIFLASH_BLANK_WORDS(sectors) > words)) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: Blank bitmap of %d words, %d needed\r\n", words, VIFLASH_BLANK_WORDS(sectors));
+    return false;
+  }
+  blank.bitmap = bitmap;
+  blank.sectors = sectors;
+  memset(bitmap, 0, VIFLASH_BLANK_WORDS(sectors) * sizeof(uint32_t));
+
+  uint32_t startTick = (NULL != tickCb) ? tickCb() : 0;
+  for(uint32_t sector = 0; sector < sectors; sector++) {
+    if(!sectorBlank(sector))
+      continue;
+    bitmap[sector / 32] |= 1U << (sector % 32);
+    blank.stats.blankSectors++;
+  }
+  blank.stats.scanTicks = (NULL != tickCb) ? tickCb() - startTick : 0;
+  blank.stats.scanSectors = sectors;
+  drv->blankMap = true;
+
+  if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+    drv->printfCb("Blank scan: %d of %d FF-sectors blank, %d ticks\r\n",
+      blank.stats.blankSectors, sectors, blank.stats.scanTicks);
+  return true;
+}
+
+void VIFLASH_BlankGetStats(VIFLASH_BlankStats_t *stats) {
+  if(NULL != stats)
+    *stats = blank.stats;
+}
@@ -0,0 +1,654 @@
+#include "viflashdrv_cmp.h"
+#include "viflashdrv_private.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CMP_MARKER     0xC5U
+#define CMP_TYPE_FILL  1U          /* payload-less, length field carries the byte value */
+#define CMP_TYPE_RAW   2U
+#define CMP_TYPE_LZ    3U
+#define CMP_MAGIC      0x31504D43U /* "CMP1" */
+#define CMP_UNIT_HEADER 8          /* magic + sequence number */
+#define CMP_RESERVE    1           /* free erase units kept for the collection */
+#define CMP_NONE       0xFFFFFFFFU /* sector without a record, unit without one */
+#define CMP_BLANK      0xFFFFFFFFU
+
+#define LZF_MAX_LIT    32
+#define LZF_MAX_REF    264         /* 2 + 7 + 255 */
+#define LZF_MAX_OFF    8192
+
+typedef struct {
+  size_t address;
+  uint32_t size;
+  uint32_t seq;        /* sequence number, 0 if free */
+  uint32_t tail;       /* offset of the first free word */
+  uint32_t live;       /* bytes of the records which are the newest of their sector */
+}Unit_t;
+
+typedef struct {
+  uint32_t sectors;
+  uint32_t *index;     /* offset of the newest record of each sector in the disk window */
+  Unit_t *units;       /* erase units inside the disk window, in address order */
+  uint32_t unitCount;
+  uint32_t head;       /* unit receiving the records, CMP_NONE if there is none */
+  uint8_t *record;     /* encode buffer */
+  uint8_t *copy;       /* copy buffer of the collection, behind the encode buffer */
+  uint8_t *payload;    /* payload read buffer, backends without memory map only */
+  VIFLASH_CmpStats_t stats;
+}Cmp_t;
+
+static Cmp_t cmp;
+
+static uint32_t readWord(size_t address) {
+  uint32_t word = CMP_BLANK;
+  VIFLASH_FlashRead(address, (uint8_t*)&word, sizeof(word));
+  return word;
+}
+
+static size_t diskAddress(uint32_t offset) {
+  return VIFLASH_GetDriver()->startDiskAddress + offset;
+}
+
+// ------------------------------------------------------------------------ codec (LZF format)
+
+static uint32_t lzfCompress(const uint8_t *in, uint32_t inLen, uint8_t *out, uint32_t outLen) {
+  uint16_t htab[VIFLASH_CMP_HASH_SIZE];  /* position + 1, 0 if empty */
+  memset(htab, 0, sizeof(htab));
+  uint32_t ip = 0;
+  uint32_t op = 1;                         /* out[0] is the control byte of the first run */
+  uint32_t lit = 0;
+  if(2 > outLen)
+    return 0;
+
+  while(ip < inLen) {
+    if(ip + 2 < inLen) {
+      uint32_t v = ((uint32_t)in[ip] << 16) | ((uint32_t)in[ip+1] << 8) | in[ip+2];
+      uint32_t h = ((v * 0x9E3779B1U) >> 16) & (VIFLASH_CMP_HASH_SIZE - 1);
+      uint32_t ref = htab[h];
+      htab[h] = ip + 1;
+      if(0 != ref--) {
+        uint32_t off = ip - ref - 1;
+        if(LZF_MAX_OFF > off && 
+           in[ref] == in[ip] && in[ref+1] == in[ip+1] && in[ref+2] == in[ip+2]) {
+          uint32_t maxLen = inLen - ip;
+          if(LZF_MAX_REF < maxLen)
+            maxLen = LZF_MAX_REF;
+          uint32_t len = 3;
+          while(len < maxLen && in[ref+len] == in[ip+len])
+            len++;
+          if(outLen < op + 4)
+            return 0;
+          // close the literal run
+          if(0 != lit)
+            out[op - lit - 1] = lit - 1;
+          else
+            op--;
+          ip += len;
+          len -= 2;
+          if(7 > len) {
+            out[op++] = (off >> 8) + (len << 5);
+          } else {
+            out[op++] = (off >> 8) + (7 << 5);
+            out[op++] = len - 7;
+          }
+          out[op++] = off & 0xFF;
+          op++;                            /* control byte of the next run */
+          lit = 0;
+          continue;
+        }
+      }
+    }
+    if(outLen < op + 2)
+      return 0;
+    lit++;
+    out[op++] = in[ip++];
+    if(LZF_MAX_LIT == lit) {
+      out[op - lit - 1] = lit - 1;
+      lit = 0;
+      op++;
+    }
+  }
+  if(0 != lit)
+    out[op - lit - 1] = lit - 1;
+  else
+    op--;
+  return op;
+}
+
+static uint32_t lzfDecompress(const uint8_t *in, uint32_t inLen, uint8_t *out, uint32_t outLen) {
+  uint32_t ip = 0;
+  uint32_t op = 0;
+  while(ip < inLen) {
+    uint32_t ctrl = in[ip++];
+    if(LZF_MAX_LIT > ctrl) {
+      ctrl++;
+      if(outLen < op + ctrl || inLen < ip + ctrl)
+        return 0;
+      memcpy(out + op, in + ip, ctrl);
+      op += ctrl;
+      ip += ctrl;
+    } else {
+      uint32_t len = ctrl >> 5;
+      if(7 == len && ip < inLen)
+        len += in[ip++];
+      if(ip >= inLen)
+        return 0;
+      uint32_t ref = ((ctrl & 0x1F) << 8) + in[ip++] + 1;
+      len += 2;
+      if(ref > op || outLen < op + len)
+        return 0;
+      for(; 0 < len; len--, op++)
+        out[op] = out[op - ref];
+    }
+  }
+  return op;
+}
+
+// ------------------------------------------------------------------------ records
+
+static uint32_t payloadSize(uint32_t header) {
+  if(CMP_TYPE_FILL == ((header >> 8) & 0xFF))
+    return 0;
+  return header >> 16;
+}
+
+// record size, 0 if the header is not valid
+static uint32_t recordSize(uint32_t header) {
+  uint32_t ffSectorSize = VIFLASH_GetDriver()->ffSectorSize;
+  uint32_t len = header >> 16;
+  if(CMP_MARKER != (header & 0xFF))
+    return 0;
+  switch((header >> 8) & 0xFF) {
+    case CMP_TYPE_FILL:
+      if(0xFF < len)
+        return 0;
+      len = 0;
+      break;
+    case CMP_TYPE_RAW:
+      if(ffSectorSize != len)
+        return 0;
+      break;
+    case CMP_TYPE_LZ:
+      if(0 == len || ffSectorSize <= len)
+        return 0;
+      break;
+    default:
+      return 0;
+  }
+  return VIFLASH_CMP_RECORD_OVERHEAD + ((len + 3) & ~3U);
+}
+
+static uint32_t recordCrc(uint32_t header, uint32_t sector, const uint8_t *payload) {
+  uint32_t crc = VIFLASH_Crc32(0, (const uint8_t*)&header, sizeof(header));
+  crc = VIFLASH_Crc32(crc, (const uint8_t*)&sector, sizeof(sector));
+  return VIFLASH_Crc32(crc, payload, payloadSize(header));
+}
+
+static bool recordValid(size_t address) {
+  uint32_t header = readWord(address);
+  uint32_t sector = readWord(address + 4);
+  const uint8_t *payload = VIFLASH_FlashMap(address + VIFLASH_CMP_RECORD_OVERHEAD,
+    cmp.payload, payloadSize(header));
+  return cmp.sectors > sector && NULL != payload &&
+    readWord(address + 8) == recordCrc(header, sector, payload);
+}
+
+// encode a FF sector to a record, the payload is padded with 0xFF
+static uint32_t encodeRecord(const uint8_t *data, uint32_t sector, uint8_t *record) {
+  uint32_t ffSectorSize = VIFLASH_GetDriver()->ffSectorSize;
+  uint8_t *payload = record + VIFLASH_CMP_RECORD_OVERHEAD;
+  uint32_t type = CMP_TYPE_FILL;
+  uint32_t len = data[0];
+  for(uint32_t i = 1; i < ffSectorSize; i++) {
+    if(data[i] != data[0]) {
+      type = CMP_TYPE_LZ;
+      break;
+    }
+  }
+  if(CMP_TYPE_LZ == type) {
+    len = lzfCompress(data, ffSectorSize, payload, ffSectorSize - 1);
+    if(0 == len) {
+      type = CMP_TYPE_RAW;
+      len = ffSectorSize;
+      memcpy(payload, data, ffSectorSize);
+    }
+  }
+  uint32_t header = CMP_MARKER | (type << 8) | (len << 16);
+  uint32_t size = recordSize(header);
+  uint32_t payloadLen = payloadSize(header);
+  memset(payload + payloadLen, 0xFF, size - VIFLASH_CMP_RECORD_OVERHEAD - payloadLen);
+  uint32_t crc = recordCrc(header, sector, payload);
+  memcpy(record, &header, sizeof(header));
+  memcpy(record + 4, &sector, sizeof(sector));
+  memcpy(record + 8, &crc, sizeof(crc));
+  return size;
+}
+
+static bool decodeRecord(size_t address, uint8_t *buff) {
+  uint32_t ffSectorSize = VIFLASH_GetDriver()->ffSectorSize;
+  uint32_t header = readWord(address);
+  if(0 == recordSize(header))
+    return false;
+  const uint8_t *payload = VIFLASH_FlashMap(address + VIFLASH_CMP_RECORD_OVERHEAD,
+    cmp.payload, payloadSize(header));
+  if(NULL == payload)
+    return false;
+  switch((header >> 8) & 0xFF) {
+    case CMP_TYPE_FILL:
+      memset(buff, header >> 16, ffSectorSize);
+      return true;
+    case CMP_TYPE_RAW:
+      memcpy(buff, payload, ffSectorSize);
+      return true;
+    default:
+      return ffSectorSize == lzfDecompress(payload, header >> 16, buff, ffSectorSize);
+  }
+}
+
+// the whole record with header, checksum and padded payload is compared,
+// equal checksums alone do not make equal sectors
+static bool flashEqual(size_t address, const uint8_t *data, uint32_t size) {
+  uint8_t scratch[32];
+  while(0 < size) {
+    uint32_t chunk = (size < sizeof(scratch)) ? size : sizeof(scratch);
+    const uint8_t *flash = VIFLASH_FlashMap(address, scratch, chunk);
+    if(NULL == flash || 0 != memcmp(flash, data, chunk))
+      return false;
+    address += chunk;
+    data += chunk;
+    size -= chunk;
+  }
+  return true;
+}
+
+static bool sameRecord(uint32_t sector, const uint8_t *record, uint32_t size) {
+  uint32_t header;
+  memcpy(&header, record, sizeof(header));
+  // a sector without record reads as 0xFF
+  if(CMP_NONE == cmp.index[sector])
+    return (CMP_MARKER | (CMP_TYPE_FILL << 8) | (0xFFU << 16)) == header;
+  return flashEqual(diskAddress(cmp.index[sector]), record, size);
+}
+
+// program a record to blank flash; header and sector first, checksum last
+static bool programRecord(size_t address, const uint8_t *record, uint32_t size) {
+  return VIFLASH_FlashProgram(address, record, 8) &&
+    (VIFLASH_CMP_RECORD_OVERHEAD == size ||
+     VIFLASH_FlashProgram(address + VIFLASH_CMP_RECORD_OVERHEAD, record + VIFLASH_CMP_RECORD_OVERHEAD,
+       size - VIFLASH_CMP_RECORD_OVERHEAD)) &&
+    VIFLASH_FlashProgram(address + 8, record + 8, 4);
+}
+
+// ------------------------------------------------------------------------ erase units
+
+// unit holding an offset of the disk window
+static uint32_t unitOf(uint32_t offset) {
+  size_t address = diskAddress(offset);
+  uint32_t low = 0, high = cmp.unitCount;
+  while(low + 1 < high) {
+    uint32_t mid = (low + high) / 2;
+    if(cmp.units[mid].address <= address)
+      low = mid;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+static uint32_t recordAt(uint32_t offset) {
+  return recordSize(readWord(diskAddress(offset)));
+}
+
+// Add the valid records of a unit to the index, return offset of the first free word;
+// the unit counts as full if anything behind that offset is not blank
+static uint32_t scanUnit(uint32_t unit) {
+  Unit_t *u = &cmp.units[unit];
+  uint32_t offset = CMP_UNIT_HEADER;
+  while(offset + VIFLASH_CMP_RECORD_OVERHEAD <= u->size) {
+    uint32_t header = readWord(u->address + offset);
+    if(CMP_BLANK == header)
+      break;
+    // a torn header gives no record size, the scan stops there
+    uint32_t size = recordSize(header);
+    if(0 == size || u->size - offset < size)
+      break;
+    // torn records are skipped
+    if(recordValid(u->address + offset))
+      cmp.index[readWord(u->address + offset + 4)] = u->address + offset - diskAddress(0);
+    offset += size;
+  }
+  // append only into blank space
+  for(uint32_t free = offset; free + 4 <= u->size; free += 4) {
+    if(CMP_BLANK != readWord(u->address + free))
+      return u->size;
+  }
+  return offset;
+}
+
+static uint32_t freeUnits(void) {
+  uint32_t count = 0;
+  for(uint32_t i = 0; i < cmp.unitCount; i++) {
+    if(0 == cmp.units[i].seq)
+      count++;
+  }
+  return count;
+}
+
+// free unit which is opened next, the units are used round robin
+static uint32_t nextFree(void) {
+  uint32_t start = (CMP_NONE == cmp.head) ? 0 : cmp.head + 1;
+  for(uint32_t i = 0; i < cmp.unitCount; i++) {
+    uint32_t unit = (start + i) % cmp.unitCount;
+    if(0 == cmp.units[unit].seq)
+      return unit;
+  }
+  return CMP_NONE;
+}
+
+static bool isBlank(const Unit_t *u) {
+  for(uint32_t offset = 0; offset < u->size; offset += 4) {
+    if(CMP_BLANK != readWord(u->address + offset))
+      return false;
+  }
+  return true;
+}
+
+static bool eraseUnit(uint32_t unit) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  Unit_t *u = &cmp.units[unit];
+  if(!VIFLASH_FlashErase(u->address)) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: Erase of compressed unit at 0x%08lX\r\n", u->address);
+    return false;
+  }
+  u->seq = 0;
+  u->tail = 0;
+  u->live = 0;
+  return true;
+}
+
+// sequence number first, the magic makes the unit valid
+static bool openUnit(void) {
+  uint32_t unit = nextFree();
+  if(CMP_NONE == unit)
+    return false;
+  Unit_t *u = &cmp.units[unit];
+  uint32_t seq = (CMP_NONE == cmp.head) ? 1 : cmp.units[cmp.head].seq + 1;
+  uint32_t magic = CMP_MAGIC;
+  if(!isBlank(u) && !eraseUnit(unit))
+    return false;
+  if(!VIFLASH_FlashProgram(u->address + 4, (const uint8_t*)&seq, sizeof(seq)) ||
+     !VIFLASH_FlashProgram(u->address, (const uint8_t*)&magic, sizeof(magic)))
+    return false;
+  u->seq = seq;
+  u->tail = CMP_UNIT_HEADER;
+  u->live = 0;
+  cmp.head = unit;
+  return true;
+}
+
+static bool headFits(uint32_t size) {
+  return CMP_NONE != cmp.head && cmp.units[cmp.head].size - cmp.units[cmp.head].tail >= size;
+}
+
+static bool collect(void);
+
+// Put a record behind the newest one and point the index of its sector to it.
+// The collection may use the reserve, writes reclaim units before they would.
+static bool place(uint32_t sector, const uint8_t *record, uint32_t size, bool collecting) {
+  for(uint32_t i = 0; !headFits(size); i++) {
+    if(collecting || CMP_RESERVE < freeUnits()) {
+      if(!openUnit())
+        return false;
+    } else if(2 * cmp.unitCount < i || !collect()) {
+      return false;
+    }
+  }
+  Unit_t *u = &cmp.units[cmp.head];
+  if(!programRecord(u->address + u->tail, record, size)) {
+    // whatever got programmed, nothing more goes behind it
+    u->tail = u->size;
+    return false;
+  }
+  if(CMP_NONE != cmp.index[sector])
+    cmp.units[unitOf(cmp.index[sector])].live -= recordAt(cmp.index[sector]);
+  cmp.index[sector] = u->address + u->tail - diskAddress(0);
+  u->tail += size;
+  u->live += size;
+  return true;
+}
+
+// Reclaim the unit with the most bytes not in use: copy its live records
+// behind the newest one, then erase it. Power loss in between leaves the copies
+// in a unit with a higher sequence number, so they win on the next scan.
+static bool collect(void) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  Unit_t *head = &cmp.units[cmp.head];
+  uint32_t room = head->size - head->tail;
+  uint32_t spare = nextFree();
+  uint32_t victim = CMP_NONE;
+  uint32_t victimDead = 0;
+  for(uint32_t i = 0; i < cmp.unitCount; i++) {
+    Unit_t *u = &cmp.units[i];
+    if(0 == u->seq || i == cmp.head)
+      continue;
+    // outdated records and the space left behind the last one
+    uint32_t dead = u->size - CMP_UNIT_HEADER - u->live;
+    // the live records have to fit behind the head or into the spare unit
+    bool fits = (u->live <= room) ||
+      (CMP_NONE != spare && u->live <= cmp.units[spare].size - CMP_UNIT_HEADER);
+    if(fits && dead > victimDead) {
+      victim = i;
+      victimDead = dead;
+    }
+  }
+  if(CMP_NONE == victim) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: Compressed disk full\r\n");
+    return false;
+  }
+  Unit_t *u = &cmp.units[victim];
+  if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+    drv->printfCb("Collect unit at 0x%08lX, %d [B] live\r\n", u->address, u->live);
+
+  for(uint32_t offset = CMP_UNIT_HEADER; 0 < u->live && offset < u->tail; ) {
+    uint32_t size = recordAt(u->address + offset - diskAddress(0));
+    if(0 == size)
+      break;
+    uint32_t sector = readWord(u->address + offset + 4);
+    if(cmp.sectors > sector && u->address + offset - diskAddress(0) == cmp.index[sector]) {
+      if(!VIFLASH_FlashRead(u->address + offset, cmp.copy, size) ||
+         !place(sector, cmp.copy, size, true))
+        return false;
+      cmp.stats.copiedBytes += size;
+    }
+    offset += size;
+  }
+  cmp.stats.collections++;
+  return eraseUnit(victim);
+}
+
+// ------------------------------------------------------------------------ driver hooks
+
+VIFLASH_Result_t VIFLASH_CmpWrite(const uint8_t *buff, uint32_t sector, uint32_t count) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  uint32_t ffSectorSize = drv->ffSectorSize;
+  bool success = VIFLASH_FlashUnlock();
+  for(uint32_t i = 0; success && i < count; i++) {
+    uint32_t size = encodeRecord(buff + i * ffSectorSize, sector + i, cmp.record);
+    uint32_t header;
+    memcpy(&header, cmp.record, sizeof(header));
+    cmp.stats.sectorsWritten++;
+    cmp.stats.bytesIn += ffSectorSize;
+    if(CMP_TYPE_FILL == ((header >> 8) & 0xFF))
+      cmp.stats.fillSectors++;
+    else if(CMP_TYPE_RAW == ((header >> 8) & 0xFF))
+      cmp.stats.rawSectors++;
+
+    if(sameRecord(sector + i, cmp.record, size)) {
+      cmp.stats.skipped++;
+      continue;
+    }
+    success = place(sector + i, cmp.record, size, false);
+    if(success) {
+      cmp.stats.appends++;
+      cmp.stats.bytesStored += size;
+    }
+  }
+  VIFLASH_FlashLock();
+
+  if(!success)
+    return VIFLASH_RESULT_ERROR;
+  return VIFLASH_RESULT_OK;
+}
+
+VIFLASH_Result_t VIFLASH_CmpRead(uint8_t *buff, uint32_t sector, uint32_t count) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  for(uint32_t i = 0; i < count; i++) {
+    uint8_t *data = buff + i * drv->ffSectorSize;
+    // never written, or nothing but torn records
+    if(CMP_NONE == cmp.index[sector + i]) {
+      memset(data, 0xFF, drv->ffSectorSize);
+      continue;
+    }
+    if(decodeRecord(diskAddress(cmp.index[sector + i]), data))
+      continue;
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: Corrupted record of sector %d\r\n", sector + i);
+    return VIFLASH_RESULT_ERROR;
+  }
+  return VIFLASH_RESULT_OK;
+}
+
+// ------------------------------------------------------------------------ public API
+
+// erase units lying completely inside the disk window
+static uint32_t listUnits(Unit_t *units) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  uint32_t count = 0;
+  for(size_t address = drv->startDiskAddress; address < drv->endDiskAddress; ) {
+    size_t unitAddress = 0;
+    uint32_t unitSize = VIFLASH_FlashUnit(address, &unitAddress);
+    if(0 == unitSize)
+      break;
+    if(unitAddress >= drv->startDiskAddress && unitAddress + unitSize <= drv->endDiskAddress) {
+      if(NULL != units) {
+        memset(&units[count], 0, sizeof(Unit_t));
+        units[count].address = unitAddress;
+        units[count].size = unitSize;
+      }
+      count++;
+    }
+    address = unitAddress + unitSize;
+  }
+  return count;
+}
+
+// Rebuild the index: units in the order they were opened, records in the order
+// they were appended, the last record of a sector wins
+static void rebuild(void) {
+  for(uint32_t i = 0; i < cmp.unitCount; i++) {
+    Unit_t *u = &cmp.units[i];
+    uint32_t seq = readWord(u->address + 4);
+    if(CMP_MAGIC == readWord(u->address) && 0 != seq && CMP_BLANK != seq)
+      u->seq = seq;
+  }
+  cmp.head = CMP_NONE;
+  uint32_t lastSeq = 0;
+  while(true) {
+    uint32_t next = CMP_NONE;
+    for(uint32_t i = 0; i < cmp.unitCount; i++) {
+      if(lastSeq < cmp.units[i].seq && 
+         (CMP_NONE == next || cmp.units[i].seq < cmp.units[next].seq))
+        next = i;
+    }
+    if(CMP_NONE == next)
+      break;
+    cmp.units[next].tail = scanUnit(next);
+    lastSeq = cmp.units[next].seq;
+    cmp.head = next;
+  }
+  for(uint32_t sector = 0; sector < cmp.sectors; sector++) {
+    if(CMP_NONE != cmp.index[sector])
+      cmp.units[unitOf(cmp.index[sector])].live += recordAt(cmp.index[sector]);
+  }
+}
+
+bool VIFLASH_EnableCompression(uint32_t sectors, bool overcommit) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  if(!drv->initialized || drv->writeProtected)
+    return false;
+
+  free(cmp.index);
+  free(cmp.units);
+  free(cmp.record);
+  free(cmp.payload);
+  memset(&cmp, 0, sizeof(cmp));
+  drv->cmpSectors = 0;
+  if(0 == sectors)
+    return true;
+
+  uint32_t maxRecord = VIFLASH_CMP_RECORD_OVERHEAD + drv->ffSectorSize;
+  uint32_t unitCount = listUnits(NULL);
+  cmp.units = (Unit_t*)malloc(unitCount * sizeof(Unit_t));
+  cmp.index = (uint32_t*)malloc(sectors * sizeof(uint32_t));
+  cmp.record = (uint8_t*)malloc(2 * maxRecord);
+  if(!drv->backend.memoryMapped)
+    cmp.payload = (uint8_t*)malloc(drv->ffSectorSize);
+  if(NULL == cmp.units || NULL == cmp.index || NULL == cmp.record ||
+     (!drv->backend.memoryMapped && NULL == cmp.payload)) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: malloc of the compression index\r\n");
+    VIFLASH_EnableCompression(0, false);
+    return false;
+  }
+  cmp.copy = cmp.record + maxRecord;
+  cmp.unitCount = listUnits(cmp.units);
+
+  // every unit takes the largest record; the records of all sectors have to fit
+  // besides the head and the reserve, at least their overhead
+  uint32_t minUnit = 0, maxUnit = 0;
+  uint64_t unitBytes = 0, rawRecords = 0;
+  for(uint32_t i = 0; i < cmp.unitCount; i++) {
+    if(0 == minUnit || cmp.units[i].size < minUnit)
+      minUnit = cmp.units[i].size;
+    if(cmp.units[i].size > maxUnit)
+      maxUnit = cmp.units[i].size;
+    unitBytes += cmp.units[i].size - CMP_UNIT_HEADER;
+    rawRecords += (cmp.units[i].size - CMP_UNIT_HEADER) / maxRecord;
+  }
+  // sectors which fit as incompressible records whatever the data
+  uint64_t reserved = (CMP_RESERVE + 1) * (uint64_t)((maxUnit - CMP_UNIT_HEADER) / maxRecord);
+  uint64_t safeSectors = (rawRecords > reserved) ? rawRecords - reserved : 0;
+  if(!overcommit && sectors > safeSectors) {
+    if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("Compression limited to %d of %d sectors\r\n", (uint32_t)safeSectors, sectors);
+    sectors = (uint32_t)safeSectors;
+  }
+  if((0 != drv->ffSectorSize % 4) || (0xFFFF < drv->ffSectorSize) ||
+     (CMP_RESERVE + 2 > cmp.unitCount) || (CMP_UNIT_HEADER + maxRecord > minUnit) ||
+     (0 == sectors) ||
+     ((uint64_t)sectors * VIFLASH_CMP_RECORD_OVERHEAD + (CMP_RESERVE + 1) * (uint64_t)maxUnit >
+      unitBytes)) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: Compression of %d sectors does not fit the disk window\r\n", sectors);
+    VIFLASH_EnableCompression(0, false);
+    return false;
+  }
+
+  cmp.sectors = sectors;
+  memset(cmp.index, 0xFF, sectors * sizeof(uint32_t));
+  rebuild();
+  drv->cmpSectors = sectors;
+  drv->digest = false;
+
+  if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+    drv->printfCb("Compression enabled: %d sectors in %d erase units, %d free\r\n",
+      sectors, cmp.unitCount, freeUnits());
+  return true;
+}
+
+void VIFLASH_CmpGetStats(VIFLASH_CmpStats_t *stats) {
+  if(NULL != stats)
+    *stats = cmp.stats;
+}
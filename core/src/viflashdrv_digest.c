@@ -0,0 +1,146 @@
+#include "viflashdrv_digest.h"
+#include "viflashdrv_private.h"
+#include <string.h>
+
+typedef struct {
+  uint32_t *table;     /* digests of the sectors, valid bits behind them */
+  uint32_t sectors;
+  VIFLASH_DigestStats_t stats;
+}Digest_t;
+
+static Digest_t dig;
+
+static bool isKnown(uint32_t sector) {
+  return 0 != (dig.table[dig.sectors + sector / 32] & (1U << (sector % 32)));
+}
+
+static void store(uint32_t sector, uint32_t digest) {
+  dig.table[sector] = digest;
+  dig.table[dig.sectors + sector / 32] |= 1U << (sector % 32);
+}
+
+static bool sectorEqual(const uint8_t *buff, uint32_t sector) {
+  return isKnown(sector) &&
+    dig.table[sector] == VIFLASH_Crc32(0, buff, VIFLASH_GetDriver()->ffSectorSize);
+}
+
+// digest of a sector on flash, false on read error
+static bool flashDigest(uint32_t sector, uint32_t *digest) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  size_t address = drv->startDiskAddress + (size_t)sector * drv->ffSectorSize;
+  if(drv->backend.memoryMapped) {
+    *digest = VIFLASH_Crc32(0, VIFLASH_FlashMap(address, NULL, drv->ffSectorSize), drv->ffSectorSize);
+    return true;
+  }
+  // read through the backend in pieces
+  uint8_t scratch[64];
+  uint32_t crc = 0;
+  for(uint32_t offset = 0; offset < drv->ffSectorSize; offset += sizeof(scratch)) {
+    uint32_t chunk = (drv->ffSectorSize - offset < sizeof(scratch)) ?
+      drv->ffSectorSize - offset : sizeof(scratch);
+    if(NULL == VIFLASH_FlashMap(address + offset, scratch, chunk))
+      return false;
+    crc = VIFLASH_Crc32(crc, scratch, chunk);
+  }
+  *digest = crc;
+  return true;
+}
+
+// equal sectors at both ends are left out, equal ones in between are merged anyway
+void VIFLASH_DigestTrim(const uint8_t *buff, uint32_t sector, uint32_t count,
+  uint32_t *first, uint32_t *last) {
+  uint32_t ffSectorSize = VIFLASH_GetDriver()->ffSectorSize;
+  *first = 0;
+  *last = count;
+  while(*first < *last && sectorEqual(buff + *first * ffSectorSize, sector + *first))
+    (*first)++;
+  while(*first < *last && sectorEqual(buff + (*last - 1) * ffSectorSize, sector + *last - 1))
+    (*last)--;
+}
+
+VIFLASH_Result_t VIFLASH_DigestWrite(const uint8_t *buff, uint32_t sector, uint32_t count) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  uint32_t first, last;
+  VIFLASH_DigestTrim(buff, sector, count, &first, &last);
+  dig.stats.skipped += count - (last - first);
+  if(first == last) {
+    if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("Skip write of FF-sectors %d..%d, content is equal\r\n", sector, sector + count - 1);
+    return VIFLASH_RESULT_OK;
+  }
+
+  VIFLASH_Result_t res = VIFLASH_WriteRange(buff + first * drv->ffSectorSize,
+    drv->startDiskAddress + (sector + first) * drv->ffSectorSize,
+    (last - first) * drv->ffSectorSize);
+  if(VIFLASH_RESULT_OK != res)
+    return res;
+  for(uint32_t i = first; i < last; i++)
+    store(sector + i, VIFLASH_Crc32(0, buff + i * drv->ffSectorSize, drv->ffSectorSize));
+  dig.stats.written += last - first;
+  return res;
+}
+
+void VIFLASH_DigestLearn(const uint8_t *buff, uint32_t sector, uint32_t count) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  for(uint32_t i = 0; i < count; i++) {
+    if(isKnown(sector + i))
+      continue;
+    store(sector + i, VIFLASH_Crc32(0, buff + i * drv->ffSectorSize, drv->ffSectorSize));
+    dig.stats.learned++;
+  }
+}
+
+void VIFLASH_DigestInvalidate(size_t address, uint32_t size) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  if(!drv->digest || address >= drv->endDiskAddress || address + size <= drv->startDiskAddress)
+    return;
+  size_t start = (address > drv->startDiskAddress) ? address : drv->startDiskAddress;
+  size_t end = (address + size < drv->endDiskAddress) ? address + size : drv->endDiskAddress;
+  uint32_t last = (end - drv->startDiskAddress + drv->ffSectorSize - 1) / drv->ffSectorSize;
+  if(last > dig.sectors)
+    last = dig.sectors;
+  for(uint32_t sector = (start - drv->startDiskAddress) / drv->ffSectorSize; sector < last; sector++) {
+    if(isKnown(sector))
+      dig.stats.invalidated++;
+    dig.table[dig.sectors + sector / 32] &= ~(1U << (sector % 32));
+  }
+}
+
+bool VIFLASH_EnableDigest(uint32_t *table, uint32_t words, bool scan) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  if(!drv->initialized || drv->writeProtected)
+    return false;
+
+  drv->digest = false;
+  memset(&dig, 0, sizeof(dig));
+  if(NULL == table)
+    return true;
+
+  uint32_t sectors = VIFLASH_DiskSectors();
+  if((0 != drv->cmpSectors) || (VIFLASH_DIGEST_WORDS(sectors) > words)) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: Digest table of %d words, %d needed\r\n", words, VIFLASH_DIGEST_WORDS(sectors));
+    return false;
+  }
+  dig.table = table;
+  dig.sectors = sectors;
+  memset(table + sectors, 0, (VIFLASH_DIGEST_WORDS(sectors) - sectors) * sizeof(uint32_t));
+
+  for(uint32_t sector = 0; scan && sector < sectors; sector++) {
+    uint32_t digest;
+    if(!flashDigest(sector, &digest))
+      continue;
+    store(sector, digest);
+    dig.stats.learned++;
+  }
+  drv->digest = true;
+
+  if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+    drv->printfCb("Digest table enabled: %d FF-sectors, %d known\r\n", sectors, dig.stats.learned);
+  return true;
+}
+
+void VIFLASH_DigestGetStats(VIFLASH_DigestStats_t *stats) {
+  if(NULL != stats)
+    *stats = dig.stats;
+}
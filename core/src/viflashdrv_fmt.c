@@ -0,0 +1,244 @@
+#include "viflashdrv_fmt.h"
+#include "viflashdrv_private.h"
+#include <stdlib.h>
+#include <string.h>
+
+// FatFs picks the FAT type by these limits, both inclusive
+#define FAT12_MAX_CLUSTERS  4085
+#define FAT16_MAX_CLUSTERS  65525
+#define DIR_ENTRY_SIZE      32
+#define MAX_CLUSTER_BYTES   32768
+
+// First erase boundary at or behind ffSector
+static uint32_t nextBoundary(uint32_t ffSector, uint32_t totalSectors) {
+  if(ffSector >= totalSectors)
+    return totalSectors;
+  uint32_t unitStart = 0, unitEnd = 0;
+  VIFLASH_EraseUnit(ffSector, &unitStart, &unitEnd);
+  return (unitStart == ffSector) ? ffSector : unitEnd;
+}
+
+static uint32_t fatBytes(uint8_t fatType, uint32_t clusterCount) {
+  if(12 == fatType)
+    return ((clusterCount + 2) * 3 + 1) / 2;
+  return (clusterCount + 2) * 2;
+}
+
+// Place the first FAT on the smallest erase sector behind the boot sector,
+// as long as the padding costs at most 1/16 of the disk. A boot sector which
+// already sits in a smallest erase sector keeps the FAT behind it.
+static uint32_t findReserved(uint32_t totalSectors, uint32_t minUnitSize) {
+  uint32_t unitStart = 0, unitEnd = 0;
+  uint32_t bootUnitSize = VIFLASH_EraseUnit(0, &unitStart, &unitEnd);
+  uint32_t maxPadding = totalSectors / 16;
+
+  if(minUnitSize >= bootUnitSize)
+    return 1;
+  for(uint32_t ffSector = unitEnd; ffSector < totalSectors && ffSector <= maxPadding; ) {
+    uint32_t unitSize = VIFLASH_EraseUnit(ffSector, &unitStart, &unitEnd);
+    if(minUnitSize == unitSize)
+      return ffSector;
+    ffSector = unitEnd;
+  }
+  // the smallest is out of reach, a smaller one than the boot sector still helps
+  VIFLASH_EraseUnit(0, &unitStart, &unitEnd);
+  if(unitEnd < totalSectors && unitEnd <= maxPadding &&
+     VIFLASH_EraseUnit(unitEnd, &unitStart, &unitEnd) < bootUnitSize)
+    return unitStart;
+  return 1;
+}
+
+// Try a layout with the given cluster size
+static bool tryLayout(VIFLASH_Format_t *fmt, uint32_t clusterSize, uint16_t rootEntries) {
+  uint32_t total = fmt->totalSectors;
+  uint32_t rootDirSectors = (rootEntries * DIR_ENTRY_SIZE + fmt->bytesPerSector - 1) / fmt->bytesPerSector;
+  uint32_t fatSectors = 1;
+  uint8_t fatType = 12;
+  uint32_t clusterCount = 0;
+
+  // FAT size depends on the cluster count and vice versa
+  for(uint32_t iter = 0; iter < 8; iter++) {
+    uint32_t metaEnd = fmt->reservedSectors + fmt->numFats * fatSectors + rootDirSectors;
+    if(metaEnd >= total)
+      return false;
+    clusterCount = (total - metaEnd) / clusterSize;
+    if(FAT16_MAX_CLUSTERS < clusterCount)
+      return false;
+    fatType = (FAT12_MAX_CLUSTERS >= clusterCount) ? 12 : 16;
+    uint32_t needed = (fatBytes(fatType, clusterCount) + fmt->bytesPerSector - 1) / fmt->bytesPerSector;
+    if(needed <= fatSectors)
+      break;
+    fatSectors = needed;
+  }
+
+  // move the data area to the next erase boundary; the gap grows the FATs
+  uint32_t metaEnd = fmt->reservedSectors + fmt->numFats * fatSectors + rootDirSectors;
+  uint32_t dataStart = nextBoundary(metaEnd, total);
+  if(dataStart >= total)
+    return false;
+  fatSectors += (dataStart - metaEnd) / fmt->numFats;
+  rootDirSectors += (dataStart - metaEnd) % fmt->numFats;
+
+  clusterCount = (total - dataStart) / clusterSize;
+  if(VIFLASH_FMT_MIN_CLUSTERS > clusterCount || FAT16_MAX_CLUSTERS < clusterCount)
+    return false;
+  fatType = (FAT12_MAX_CLUSTERS >= clusterCount) ? 12 : 16;
+
+  // clusters must not straddle erase sectors
+  uint64_t eraseBytes = 0;
+  for(uint32_t ffSector = dataStart; ffSector < dataStart + clusterCount * clusterSize; ) {
+    uint32_t unitStart = 0, unitEnd = 0;
+    uint32_t unitSize = VIFLASH_EraseUnit(ffSector, &unitStart, &unitEnd);
+    if(unitStart > dataStart && 0 != (unitStart - dataStart) % clusterSize)
+      return false;
+    uint32_t stop = unitEnd < dataStart + clusterCount * clusterSize ?
+      unitEnd : dataStart + clusterCount * clusterSize;
+    eraseBytes += (uint64_t)unitSize * ((stop - ffSector) / clusterSize);
+    ffSector = unitEnd;
+  }
+
+  uint32_t unitStart = 0, unitEnd = 0;
+  fmt->fatType = fatType;
+  fmt->clusterSize = clusterSize;
+  fmt->fatSectors = fatSectors;
+  fmt->rootDirSectors = rootDirSectors;
+  fmt->rootEntries = rootDirSectors * fmt->bytesPerSector / DIR_ENTRY_SIZE;
+  fmt->dataStartSector = dataStart;
+  fmt->clusterCount = clusterCount;
+  fmt->fatEraseSize = VIFLASH_EraseUnit(fmt->reservedSectors, &unitStart, &unitEnd);
+  fmt->dataEraseSize = (uint32_t)(eraseBytes / clusterCount);
+  fmt->eraseCostPerClusterWrite = fmt->fatEraseSize + fmt->dataEraseSize;
+  return true;
+}
+
+bool VIFLASH_ComputeFormat(uint8_t numFats, uint16_t rootEntries,
+  VIFLASH_Format_t *fmt) {
+  Driver_t *drv = VIFLASH_GetDriver();
+
+  if(NULL == fmt || 0 == numFats || 2 < numFats)
+    return false;
+  if(!drv->initialized)
+    return false;
+
+  memset(fmt, 0, sizeof(VIFLASH_Format_t));
+  fmt->bytesPerSector = drv->ffSectorSize;
+  fmt->totalSectors = (drv->endDiskAddress - drv->startDiskAddress) / drv->ffSectorSize;
+  fmt->numFats = numFats;
+
+  uint32_t blockSize = 0;
+  if(VIFLASH_RESULT_OK != VIFLASH_Ioctl(VIFLASH_GET_BLOCK_SIZE, &blockSize))
+    return false;
+  fmt->dataAlign = blockSize;
+  fmt->reservedSectors = findReserved(fmt->totalSectors, blockSize * drv->ffSectorSize);
+
+  uint32_t clusterSize = 1;
+  while(clusterSize * 2 <= blockSize && clusterSize * 2 <= VIFLASH_FMT_MAX_CLUSTER &&
+        clusterSize * 2 * drv->ffSectorSize <= MAX_CLUSTER_BYTES)
+    clusterSize *= 2;
+
+  for(; 0 < clusterSize; clusterSize /= 2) {
+    if(tryLayout(fmt, clusterSize, rootEntries)) {
+      if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+        drv->printfCb("FAT%d: cluster %ld; reserved %ld; FAT %ld; data %ld; erase cost %ld [B]\r\n",
+          fmt->fatType, fmt->clusterSize, fmt->reservedSectors, fmt->fatSectors,
+          fmt->dataStartSector, fmt->eraseCostPerClusterWrite);
+      return true;
+    }
+  }
+
+  if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+    drv->printfCb("ERROR: No FAT layout fits the disk\r\n");
+  return false;
+}
+
+static void putWord(uint8_t *buff, uint16_t value) {
+  buff[0] = (uint8_t)value;
+  buff[1] = (uint8_t)(value >> 8);
+}
+
+static void putDword(uint8_t *buff, uint32_t value) {
+  putWord(buff, (uint16_t)value);
+  putWord(buff + 2, (uint16_t)(value >> 16));
+}
+
+void VIFLASH_BuildBootSector(const VIFLASH_Format_t *fmt, uint8_t *buff) {
+  memset(buff, 0, fmt->bytesPerSector);
+  memcpy(buff, "\xEB\x3C\x90" "MSDOS5.0", 11);
+  putWord(buff + 11, (uint16_t)fmt->bytesPerSector);
+  buff[13] = (uint8_t)fmt->clusterSize;
+  putWord(buff + 14, (uint16_t)fmt->reservedSectors);
+  buff[16] = fmt->numFats;
+  putWord(buff + 17, fmt->rootEntries);
+  if(0x10000 > fmt->totalSectors)
+    putWord(buff + 19, (uint16_t)fmt->totalSectors);
+  else
+    putDword(buff + 32, fmt->totalSectors);
+  buff[21] = 0xF8;                            // media: fixed disk
+  putWord(buff + 22, (uint16_t)fmt->fatSectors);
+  putWord(buff + 24, 63);                     // sectors per track
+  putWord(buff + 26, 255);                    // heads
+  buff[36] = 0x80;                            // drive number
+  buff[38] = 0x29;                            // extended boot signature
+  putDword(buff + 39, 0x1F2E3D4C);            // volume serial number
+  memcpy(buff + 43, "NO NAME    ", 11);
+  memcpy(buff + 54, (12 == fmt->fatType) ? "FAT12   " : "FAT16   ", 8);
+  if(512 <= fmt->bytesPerSector) {
+    buff[510] = 0x55;
+    buff[511] = 0xAA;
+  }
+}
+
+// Content of a metadata FF-sector of a freshly formatted volume
+static void buildMetaSector(const VIFLASH_Format_t *fmt, uint32_t ffSector, uint8_t *buff) {
+  if(0 == ffSector) {
+    VIFLASH_BuildBootSector(fmt, buff);
+    return;
+  }
+  if(ffSector < fmt->reservedSectors) {
+    memset(buff, 0xFF, fmt->bytesPerSector);
+    return;
+  }
+  memset(buff, 0, fmt->bytesPerSector);
+  uint32_t fatOffset = ffSector - fmt->reservedSectors;
+  if(fatOffset < fmt->numFats * fmt->fatSectors && 0 == fatOffset % fmt->fatSectors) {
+    // entries 0 and 1: media type and end of chain
+    buff[0] = 0xF8;
+    buff[1] = 0xFF;
+    buff[2] = 0xFF;
+    if(16 == fmt->fatType)
+      buff[3] = 0xFF;
+  }
+}
+
+VIFLASH_Result_t VIFLASH_FormatVolume(const VIFLASH_Format_t *fmt) {
+  Driver_t *drv = VIFLASH_GetDriver();
+
+  if(!drv->initialized)
+    return VIFLASH_RESULT_NOTRDY;
+  if(NULL == fmt || fmt->bytesPerSector != drv->ffSectorSize ||
+     fmt->dataStartSector >= fmt->totalSectors)
+    return VIFLASH_RESULT_PARERR;
+
+  // one write per erase sector, so every sector is erased at most once
+  VIFLASH_Result_t res = VIFLASH_RESULT_OK;
+  for(uint32_t ffSector = 0; ffSector < fmt->dataStartSector && VIFLASH_RESULT_OK == res; ) {
+    uint32_t unitStart = 0, unitEnd = 0;
+    VIFLASH_EraseUnit(ffSector, &unitStart, &unitEnd);
+    if(unitEnd > fmt->dataStartSector)
+      unitEnd = fmt->dataStartSector;
+
+    uint32_t count = unitEnd - ffSector;
+    uint8_t *buff = (uint8_t*)malloc(count * fmt->bytesPerSector);
+    if(NULL == buff) {
+      if(VIFLASH_DEBUG_DISABLED < drv->debugLvl && NULL != drv->printfCb)
+        drv->printfCb("ERROR: malloc(%d) \r\n", count * fmt->bytesPerSector);
+      return VIFLASH_RESULT_ERROR;
+    }
+    for(uint32_t i = 0; i < count; i++)
+      buildMetaSector(fmt, ffSector + i, buff + i * fmt->bytesPerSector);
+    res = VIFLASH_Write(buff, ffSector, count);
+    free(buff);
+    ffSector = unitEnd;
+  }
+  return res;
+}
@@ -0,0 +1,121 @@
+#include "viflashdrv_img.h"
+#include "viflashdrv_private.h"
+#include <string.h>
+
+static void putDword(uint8_t *buff, uint32_t value) {
+  buff[0] = (uint8_t)value;
+  buff[1] = (uint8_t)(value >> 8);
+  buff[2] = (uint8_t)(value >> 16);
+  buff[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t getDword(const uint8_t *buff) {
+  return (uint32_t)buff[0] | ((uint32_t)buff[1] << 8) |
+    ((uint32_t)buff[2] << 16) | ((uint32_t)buff[3] << 24);
+}
+
+// images hold the plain layout, not compressed records
+static bool plainDisk(void) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  return drv->initialized && 0 == drv->cmpSectors;
+}
+
+static uint32_t chunkCrc(uint32_t first, uint32_t count) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  size_t address = drv->startDiskAddress + (size_t)first * drv->ffSectorSize;
+  uint32_t size = count * drv->ffSectorSize;
+  if(drv->backend.memoryMapped)
+    return VIFLASH_Crc32(0, VIFLASH_FlashMap(address, NULL, size), size);
+  // read through the backend in pieces
+  uint8_t scratch[64];
+  uint32_t crc = 0;
+  for(uint32_t offset = 0; offset < size; offset += sizeof(scratch)) {
+    uint32_t chunk = (size - offset < sizeof(scratch)) ? size - offset : sizeof(scratch);
+    if(NULL == VIFLASH_FlashMap(address + offset, scratch, chunk))
+      return ~crc;
+    crc = VIFLASH_Crc32(crc, scratch, chunk);
+  }
+  return crc;
+}
+
+uint32_t VIFLASH_ImgChunks(void) {
+  if(!plainDisk())
+    return 0;
+  uint32_t chunks = 0;
+  uint32_t diskSectors = VIFLASH_DiskSectors();
+  for(uint32_t ffSector = 0; ffSector < diskSectors; chunks++) {
+    uint32_t unitStart = 0;
+    VIFLASH_EraseUnit(ffSector, &unitStart, &ffSector);
+  }
+  return chunks;
+}
+
+uint32_t VIFLASH_ImgBuildManifest(uint8_t *manifest, uint32_t size) {
+  uint32_t chunks = VIFLASH_ImgChunks();
+  uint32_t manifestSize = VIFLASH_IMG_MANIFEST_SIZE(chunks);
+  if(0 == chunks || NULL == manifest || manifestSize > size)
+    return 0;
+
+  putDword(manifest, VIFLASH_IMG_MAGIC);
+  putDword(manifest + 4, VIFLASH_IMG_VERSION);
+  putDword(manifest + 8, VIFLASH_GetDriver()->ffSectorSize);
+  putDword(manifest + 12, VIFLASH_DiskSectors());
+  putDword(manifest + 16, chunks);
+  uint8_t *chunk = manifest + VIFLASH_IMG_HEADER_SIZE;
+  for(uint32_t ffSector = 0; ffSector < VIFLASH_DiskSectors(); chunk += VIFLASH_IMG_CHUNK_SIZE) {
+    uint32_t unitStart = 0, unitEnd = 0;
+    VIFLASH_EraseUnit(ffSector, &unitStart, &unitEnd);
+    putDword(chunk, ffSector);
+    putDword(chunk + 4, unitEnd - ffSector);
+    putDword(chunk + 8, chunkCrc(ffSector, unitEnd - ffSector));
+    ffSector = unitEnd;
+  }
+  putDword(chunk, VIFLASH_Crc32(0, manifest, manifestSize - 4));
+  return manifestSize;
+}
+
+VIFLASH_Result_t VIFLASH_ImgVerify(const uint8_t *manifest, uint32_t size,
+  VIFLASH_ImgReport_t *report) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  VIFLASH_ImgReport_t result = {0, 0, 0};
+  if(NULL != report)
+    *report = result;
+
+  if(!drv->initialized)
+    return VIFLASH_RESULT_NOTRDY;
+  if(!plainDisk() || NULL == manifest || VIFLASH_IMG_MANIFEST_SIZE(0) > size)
+    return VIFLASH_RESULT_PARERR;
+  uint32_t chunks = getDword(manifest + 16);
+  if(VIFLASH_IMG_MAGIC != getDword(manifest) || VIFLASH_IMG_VERSION != getDword(manifest + 4) ||
+     (size - VIFLASH_IMG_MANIFEST_SIZE(0)) / VIFLASH_IMG_CHUNK_SIZE < chunks ||
+     getDword(manifest + VIFLASH_IMG_MANIFEST_SIZE(chunks) - 4) !=
+       VIFLASH_Crc32(0, manifest, VIFLASH_IMG_MANIFEST_SIZE(chunks) - 4)) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: Damaged image manifest\r\n");
+    return VIFLASH_RESULT_PARERR;
+  }
+  if(drv->ffSectorSize != getDword(manifest + 8) || VIFLASH_DiskSectors() != getDword(manifest + 12)) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: Image manifest for another disk\r\n");
+    return VIFLASH_RESULT_PARERR;
+  }
+
+  result.chunks = chunks;
+  const uint8_t *chunk = manifest + VIFLASH_IMG_HEADER_SIZE;
+  for(uint32_t i = 0; i < chunks; i++, chunk += VIFLASH_IMG_CHUNK_SIZE) {
+    uint32_t first = getDword(chunk);
+    uint32_t count = getDword(chunk + 4);
+    if(VIFLASH_DiskSectors() < count || VIFLASH_DiskSectors() - count < first)
+      return VIFLASH_RESULT_PARERR;
+    if(getDword(chunk + 8) == chunkCrc(first, count))
+      continue;
+    if(0 == result.badChunks)
+      result.firstBadSector = first;
+    result.badChunks++;
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: Image chunk at FF-sector %d differs\r\n", first);
+  }
+  if(NULL != report)
+    *report = result;
+  return (0 == result.badChunks) ? VIFLASH_RESULT_OK : VIFLASH_RESULT_ERROR;
+}
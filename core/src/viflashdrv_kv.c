@@ -0,0 +1,511 @@
+#include "viflashdrv_kv.h"
+#include "viflashdrv_private.h"
+#include <string.h>
+
+#define KV_MAX_SECTORS  8
+#define KV_MAGIC        0x3156564BU  /* "KVV1" */
+#define KV_HEADER_SIZE  8            /* magic + sequence number */
+#define KV_DELETED      0x8000U      /* length flag of a tombstone */
+#define KV_EMPTY        0xFFFFU      /* free index entry */
+#define KV_REMOVED      0xFFFEU      /* index entry of a deleted key */
+#define KV_BLANK        0xFFFFFFFFU
+
+typedef struct {
+  uint16_t key;
+  size_t address;      /* record in flash */
+}KvEntry_t;
+
+typedef struct {
+  bool initialized;
+  uint8_t firstSector;
+  uint8_t sectorCount;
+  uint32_t seq[KV_MAX_SECTORS];   /* sequence number of each sector, 0 if spare */
+  uint8_t active;                 /* sector receiving the records */
+  uint32_t writeOffset;           /* next record in the active sector */
+  uint32_t keys;
+  uint32_t compactions;
+  uint32_t wordsProgrammed;
+  KvEntry_t index[VIFLASH_KV_MAX_KEYS];
+}Kv_t;
+
+static Kv_t kv;
+
+static uint32_t readWord(size_t address) {
+  uint32_t word = KV_BLANK;
+  VIFLASH_FlashRead(address, (uint8_t*)&word, sizeof(word));
+  return word;
+}
+
+static size_t sectorAddress(uint8_t page) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  size_t address = 0;
+  drv->backend.sectorCb(drv->backend.context, kv.firstSector + page, &address);
+  return address;
+}
+
+static uint32_t sectorSize(uint8_t page) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  size_t address = 0;
+  return drv->backend.sectorCb(drv->backend.context, kv.firstSector + page, &address);
+}
+
+// CRC of flash content, read in pieces for backends without memory map
+static uint32_t flashCrc(uint32_t crc, size_t address, uint32_t size) {
+  uint8_t scratch[32];
+  while(0 < size) {
+    uint32_t chunk = (size < sizeof(scratch)) ? size : sizeof(scratch);
+    const uint8_t *data = VIFLASH_FlashMap(address, scratch, chunk);
+    if(NULL == data)
+      return ~crc;
+    if(VIFLASH_GetDriver()->backend.memoryMapped)
+      chunk = size;
+    crc = VIFLASH_Crc32(crc, data, chunk);
+    address += chunk;
+    size -= chunk;
+  }
+  return crc;
+}
+
+static bool flashEqual(size_t address, const uint8_t *data, uint32_t size) {
+  uint8_t scratch[32];
+  while(0 < size) {
+    uint32_t chunk = (size < sizeof(scratch)) ? size : sizeof(scratch);
+    const uint8_t *flash = VIFLASH_FlashMap(address, scratch, chunk);
+    if(NULL == flash || 0 != memcmp(flash, data, chunk))
+      return false;
+    address += chunk;
+    data += chunk;
+    size -= chunk;
+  }
+  return true;
+}
+
+static uint32_t recordSize(uint32_t header) {
+  uint32_t len = header >> 16;
+  if(len & KV_DELETED)
+    len = 0;
+  return 4 + ((len + 3) & ~3U) + 4;
+}
+
+// ------------------------------------------------------------------------ RAM index
+
+static uint32_t slotOf(uint16_t key) {
+  return ((uint32_t)key * 0x9E37U) & (VIFLASH_KV_MAX_KEYS - 1);
+}
+
+static KvEntry_t* findEntry(uint16_t key) {
+  uint32_t slot = slotOf(key);
+  for(uint32_t i = 0; i < VIFLASH_KV_MAX_KEYS; i++) {
+    KvEntry_t *entry = &kv.index[(slot + i) & (VIFLASH_KV_MAX_KEYS - 1)];
+    if(KV_EMPTY == entry->key)
+      return NULL;
+    if(key == entry->key)
+      return entry;
+  }
+  return NULL;
+}
+
+static bool putEntry(uint16_t key, size_t address) {
+  KvEntry_t *entry = findEntry(key);
+  if(NULL != entry) {
+    entry->address = address;
+    return true;
+  }
+  // keep one empty entry to terminate the probing
+  if(VIFLASH_KV_MAX_KEYS - 1 <= kv.keys)
+    return false;
+  uint32_t slot = slotOf(key);
+  for(uint32_t i = 0; i < VIFLASH_KV_MAX_KEYS; i++) {
+    entry = &kv.index[(slot + i) & (VIFLASH_KV_MAX_KEYS - 1)];
+    if(KV_EMPTY == entry->key || KV_REMOVED == entry->key) {
+      entry->key = key;
+      entry->address = address;
+      kv.keys++;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void removeEntry(uint16_t key) {
+  KvEntry_t *entry = findEntry(key);
+  if(NULL != entry) {
+    entry->key = KV_REMOVED;
+    kv.keys--;
+  }
+}
+
+// ------------------------------------------------------------------------ flash access
+
+static bool programWord(size_t address, uint32_t word) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  if(!VIFLASH_FlashProgram(address, (const uint8_t*)&word, sizeof(word))) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: KV word write error at address 0x%08lX\r\n", address);
+    return false;
+  }
+  kv.wordsProgrammed++;
+  return true;
+}
+
+static bool eraseSector(uint8_t page) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+    drv->printfCb("KV erase sector %d\r\n", kv.firstSector + page);
+  if(!VIFLASH_FlashErase(sectorAddress(page))) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: KV erase sector %d\r\n", kv.firstSector + page);
+    return false;
+  }
+  kv.seq[page] = 0;
+  return true;
+}
+
+static bool isBlank(uint8_t page) {
+  size_t address = sectorAddress(page);
+  uint32_t size = sectorSize(page);
+  for(uint32_t offset = 0; offset < size; offset += 4) {
+    if(KV_BLANK != readWord(address + offset))
+      return false;
+  }
+  return true;
+}
+
+// Program a record; data comes from RAM, or from flash at source if NULL (compaction)
+static bool programRecord(uint32_t header, const uint8_t *data, size_t source,
+  uint32_t len, size_t *address) {
+  size_t recordAddress = sectorAddress(kv.active) + kv.writeOffset;
+  size_t current = recordAddress;
+  uint32_t crc = VIFLASH_Crc32(0, (const uint8_t*)&header, 4);
+  crc = (NULL != data) ? VIFLASH_Crc32(crc, data, len) : flashCrc(crc, source, len);
+
+  if(!programWord(current, header))
+    return false;
+  current += 4;
+  for(uint32_t i = 0; i < len; i += 4) {
+    uint32_t word = KV_BLANK;
+    // padding of a flash record is blank already
+    if(NULL == data)
+      word = readWord(source + i);
+    else
+      memcpy(&word, data + i, (len - i < 4) ? len - i : 4);
+    if(KV_BLANK != word && !programWord(current, word))
+      return false;
+    current += 4;
+  }
+  // checksum last: a record is valid only when complete
+  if(KV_BLANK != crc && !programWord(current, crc))
+    return false;
+
+  kv.writeOffset += recordSize(header);
+  *address = recordAddress;
+  return true;
+}
+
+static bool recordValid(size_t address, uint32_t header) {
+  uint32_t len = header >> 16;
+  if(len & KV_DELETED)
+    len = 0;
+  uint32_t crc = VIFLASH_Crc32(0, (const uint8_t*)&header, 4);
+  crc = flashCrc(crc, address + 4, len);
+  return crc == readWord(address + recordSize(header) - 4);
+}
+
+// a header which can have been written by append, torn headers are not
+static bool headerValid(uint32_t header) {
+  uint32_t len = header >> 16;
+  return (VIFLASH_KV_MAX_KEY >= (uint16_t)header) &&
+    (0 == (len & KV_DELETED) || KV_DELETED == len);
+}
+
+// Add the records of a sector to the index, return offset of the first free word;
+// the sector counts as full if anything behind that offset is not blank
+static uint32_t scanSector(uint8_t page) {
+  size_t address = sectorAddress(page);
+  uint32_t size = sectorSize(page);
+  uint32_t offset = KV_HEADER_SIZE;
+
+  while(offset + 4 <= size) {
+    uint32_t header = readWord(address + offset);
+    // a torn header gives no record size, the scan stops there
+    if(KV_BLANK == header || !headerValid(header))
+      break;
+    uint32_t recSize = recordSize(header);
+    if(offset + recSize > size)
+      break;
+    // torn records are skipped
+    if(recordValid(address + offset, header)) {
+      if((header >> 16) & KV_DELETED)
+        removeEntry((uint16_t)header);
+      else
+        putEntry((uint16_t)header, address + offset);
+    }
+    offset += recSize;
+  }
+  // append only into blank space
+  for(uint32_t free = offset; free + 4 <= size; free += 4) {
+    if(KV_BLANK != readWord(address + free))
+      return size;
+  }
+  return offset;
+}
+
+static int32_t findSpare(void) {
+  for(uint8_t i = 1; i <= kv.sectorCount; i++) {
+    uint8_t page = (kv.active + i) % kv.sectorCount;
+    if(0 == kv.seq[page])
+      return page;
+  }
+  return -1;
+}
+
+static int32_t findOldest(void) {
+  int32_t oldest = -1;
+  for(uint8_t page = 0; page < kv.sectorCount; page++) {
+    if(0 != kv.seq[page] && page != kv.active &&
+       (0 > oldest || kv.seq[page] < kv.seq[oldest]))
+      oldest = page;
+  }
+  return oldest;
+}
+
+static bool openSector(uint8_t page, uint32_t seq) {
+  if(!isBlank(page) && !eraseSector(page))
+    return false;
+  if(!programWord(sectorAddress(page) + 4, seq) ||
+     !programWord(sectorAddress(page), KV_MAGIC))
+    return false;
+  kv.seq[page] = seq;
+  kv.active = page;
+  kv.writeOffset = KV_HEADER_SIZE;
+  return true;
+}
+
+// Copy the live records of the oldest sector into the active one and erase it
+static bool compactOldest(void) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  int32_t oldest = findOldest();
+  if(0 > oldest)
+    return false;
+  size_t start = sectorAddress((uint8_t)oldest);
+  size_t stop = start + sectorSize((uint8_t)oldest);
+  if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+    drv->printfCb("KV compact sector %d into %d\r\n",
+      kv.firstSector + oldest, kv.firstSector + kv.active);
+
+  for(uint32_t i = 0; i < VIFLASH_KV_MAX_KEYS; i++) {
+    KvEntry_t *entry = &kv.index[i];
+    if(KV_REMOVED <= entry->key || entry->address < start || entry->address >= stop)
+      continue;
+    uint32_t header = readWord(entry->address);
+    if(kv.writeOffset + recordSize(header) > sectorSize(kv.active))
+      return false;
+    if(!programRecord(header, NULL, entry->address + 4, header >> 16, &entry->address))
+      return false;
+  }
+  kv.compactions++;
+  return eraseSector((uint8_t)oldest);
+}
+
+// Move to the next sector; compact when no spare sector is left
+static bool nextSector(void) {
+  int32_t spare = findSpare();
+  if(0 > spare)
+    return false;
+  if(!openSector((uint8_t)spare, kv.seq[kv.active] + 1))
+    return false;
+  if(0 <= findSpare())
+    return true;
+  return compactOldest();
+}
+
+static VIFLASH_Result_t append(uint16_t key, uint32_t len, const uint8_t *data) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  uint32_t header = key | (len << 16);
+  uint32_t recSize = recordSize(header);
+
+  if(recSize > sectorSize(kv.active) - KV_HEADER_SIZE)
+    return VIFLASH_RESULT_PARERR;
+
+  bool success = VIFLASH_FlashUnlock();
+  for(uint8_t i = 0; success && kv.writeOffset + recSize > sectorSize(kv.active); i++) {
+    if(i >= kv.sectorCount || !nextSector())
+      success = false;
+  }
+  size_t address = 0;
+  if(success)
+    success = programRecord(header, data, 0, (len & KV_DELETED) ? 0 : len, &address);
+  VIFLASH_FlashLock();
+
+  if(!success) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: KV append key %d\r\n", key);
+    return VIFLASH_RESULT_ERROR;
+  }
+  if(len & KV_DELETED)
+    removeEntry(key);
+  else
+    putEntry(key, address);
+  return VIFLASH_RESULT_OK;
+}
+
+// ------------------------------------------------------------------------ API
+
+bool VIFLASH_KvInit(uint8_t firstSector, uint8_t sectorCount) {
+  Driver_t *drv = VIFLASH_GetDriver();
+
+  kv.initialized = false;
+  if(!drv->initialized || 2 > sectorCount || KV_MAX_SECTORS < sectorCount)
+    return false;
+
+  kv.firstSector = firstSector;
+  kv.sectorCount = sectorCount;
+  kv.keys = 0;
+  kv.compactions = 0;
+  kv.wordsProgrammed = 0;
+  for(uint32_t i = 0; i < VIFLASH_KV_MAX_KEYS; i++)
+    kv.index[i].key = KV_EMPTY;
+
+  // the store must not share a flash sector with the disk
+  for(uint8_t page = 0; page < sectorCount; page++) {
+    size_t start = sectorAddress(page);
+    size_t stop = start + sectorSize(page);
+    if(start == stop) {
+      if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+        drv->printfCb("ERROR: KV sector %d does not exist\r\n", firstSector + page);
+      return false;
+    }
+    if(start < drv->endDiskAddress && stop > drv->startDiskAddress) {
+      if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+        drv->printfCb("ERROR: KV sector %d overlaps the disk\r\n", firstSector + page);
+      return false;
+    }
+  }
+  if(drv->writeProtected)
+    return false;
+  drv->writeProtected = true;
+
+  uint32_t maxSeq = 0;
+  for(uint8_t page = 0; page < sectorCount; page++) {
+    bool valid = (KV_MAGIC == readWord(sectorAddress(page)));
+    kv.seq[page] = valid ? readWord(sectorAddress(page) + 4) : 0;
+    if(valid && kv.seq[page] >= maxSeq) {
+      maxSeq = kv.seq[page];
+      kv.active = page;
+    }
+  }
+
+  bool success = VIFLASH_FlashUnlock();
+  if(success && 0 == maxSeq) {
+    // empty store
+    kv.active = 0;
+    success = openSector(0, 1);
+  } else if(success) {
+    // replay the sectors from the oldest to the newest
+    uint32_t lastSeq = 0;
+    for(uint8_t n = 0; n < sectorCount; n++) {
+      int32_t next = -1;
+      for(uint8_t page = 0; page < sectorCount; page++) {
+        if(kv.seq[page] > lastSeq && (0 > next || kv.seq[page] < kv.seq[next]))
+          next = page;
+      }
+      if(0 > next)
+        break;
+      lastSeq = kv.seq[next];
+      uint32_t offset = scanSector((uint8_t)next);
+      if(next == kv.active)
+        kv.writeOffset = offset;
+    }
+    // a compaction was cut off before the erase: records still in the oldest
+    // sector are the live ones, the copies of the others are newer
+    if(0 > findSpare()) {
+      if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+        drv->printfCb("KV finish interrupted compaction\r\n");
+      success = compactOldest();
+    }
+  }
+  VIFLASH_FlashLock();
+  drv->writeProtected = false;
+
+  kv.initialized = success;
+  if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+    drv->printfCb("KV init: %ld keys; active sector %d; offset %ld\r\n",
+      kv.keys, kv.firstSector + kv.active, kv.writeOffset);
+  return success;
+}
+
+VIFLASH_Result_t VIFLASH_KvSet(uint16_t key, const void *value, uint16_t size) {
+  Driver_t *drv = VIFLASH_GetDriver();
+
+  if(!kv.initialized)
+    return VIFLASH_RESULT_NOTRDY;
+  if(VIFLASH_KV_MAX_KEY < key || VIFLASH_KV_MAX_VALUE < size || (NULL == value && 0 != size))
+    return VIFLASH_RESULT_PARERR;
+  if(drv->writeProtected) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: Write protected\r\n");
+    return VIFLASH_RESULT_WRPRT;
+  }
+
+  // unchanged value costs nothing
+  KvEntry_t *entry = findEntry(key);
+  if(NULL != entry) {
+    uint32_t header = readWord(entry->address);
+    if(size == (header >> 16) && flashEqual(entry->address + 4, (const uint8_t*)value, size))
+      return VIFLASH_RESULT_OK;
+  } else if(VIFLASH_KV_MAX_KEYS - 1 <= kv.keys) {
+    if(VIFLASH_DEBUG_ERROR <= drv->debugLvl && NULL != drv->printfCb)
+      drv->printfCb("ERROR: KV index full\r\n");
+    return VIFLASH_RESULT_ERROR;
+  }
+
+  drv->writeProtected = true;
+  VIFLASH_Result_t res = append(key, size, (const uint8_t*)value);
+  drv->writeProtected = false;
+  return res;
+}
+
+VIFLASH_Result_t VIFLASH_KvGet(uint16_t key, void *value, uint16_t size, uint16_t *read) {
+  if(!kv.initialized)
+    return VIFLASH_RESULT_NOTRDY;
+  if(VIFLASH_KV_MAX_KEY < key || (NULL == value && 0 != size))
+    return VIFLASH_RESULT_PARERR;
+
+  KvEntry_t *entry = findEntry(key);
+  if(NULL == entry)
+    return VIFLASH_RESULT_ERROR;
+  uint16_t len = (uint16_t)(readWord(entry->address) >> 16);
+  if(0 != size && !VIFLASH_FlashRead(entry->address + 4, (uint8_t*)value, (len < size) ? len : size))
+    return VIFLASH_RESULT_ERROR;
+  if(NULL != read)
+    *read = len;
+  return VIFLASH_RESULT_OK;
+}
+
+VIFLASH_Result_t VIFLASH_KvDelete(uint16_t key) {
+  Driver_t *drv = VIFLASH_GetDriver();
+
+  if(!kv.initialized)
+    return VIFLASH_RESULT_NOTRDY;
+  if(VIFLASH_KV_MAX_KEY < key)
+    return VIFLASH_RESULT_PARERR;
+  if(NULL == findEntry(key))
+    return VIFLASH_RESULT_OK;
+  if(drv->writeProtected)
+    return VIFLASH_RESULT_WRPRT;
+
+  drv->writeProtected = true;
+  VIFLASH_Result_t res = append(key, KV_DELETED, NULL);
+  drv->writeProtected = false;
+  return res;
+}
+
+void VIFLASH_KvGetStats(VIFLASH_KvStats_t *stats) {
+  if(NULL == stats)
+    return;
+  stats->keys = kv.keys;
+  stats->usedBytes = kv.initialized ? kv.writeOffset : 0;
+  stats->freeBytes = kv.initialized ? sectorSize(kv.active) - kv.writeOffset : 0;
+  stats->compactions = kv.compactions;
+  stats->wordsProgrammed = kv.wordsProgrammed;
+}
@@ -0,0 +1,280 @@
+#include "viflashdrv_queue.h"
+#include "viflashdrv_private.h"
+#include <string.h>
+
+typedef struct {
+  bool initialized;
+  VIFLASH_QueueHooks_t hooks;
+  VIFLASH_Request_t *head;     /* pending requests in submission order */
+  VIFLASH_Request_t *tail;
+  uint32_t queued;
+  uint32_t seq;
+  uint32_t position;           /* elevator: sector behind the last served request */
+  VIFLASH_QueueStats_t stats;
+}Queue_t;
+
+static Queue_t queue;
+
+static void lock(void) {
+  if(NULL != queue.hooks.lock)
+    queue.hooks.lock();
+}
+
+static void unlock(void) {
+  if(NULL != queue.hooks.unlock)
+    queue.hooks.unlock();
+}
+
+// ------------------------------------------------------------------------ scheduling
+
+static bool overlap(const VIFLASH_Request_t *a, const VIFLASH_Request_t *b) {
+  return (a->sector < b->sector + b->count) && (b->sector < a->sector + a->count);
+}
+
+static bool conflict(const VIFLASH_Request_t *a, const VIFLASH_Request_t *b) {
+  return overlap(a, b) && (VIFLASH_REQ_WRITE == a->op || VIFLASH_REQ_WRITE == b->op);
+}
+
+// waiting requests are raised up to normal, urgent stays reserved
+static uint8_t effectivePrio(const VIFLASH_Request_t *req) {
+  uint32_t raise = req->passed / VIFLASH_QUEUE_MAX_PASS;
+  if(VIFLASH_PRIO_NORMAL >= req->prio)
+    return req->prio;
+  if((uint32_t)(req->prio - VIFLASH_PRIO_NORMAL) <= raise)
+    return VIFLASH_PRIO_NORMAL;
+  return req->prio - raise;
+}
+
+// one-way elevator: sectors behind the position come after the end of the disk
+static uint32_t distance(const VIFLASH_Request_t *req) {
+  if(req->sector >= queue.position)
+    return req->sector - queue.position;
+  return req->sector + VIFLASH_DiskSectors() - queue.position;
+}
+
+static VIFLASH_Request_t* pickNext(void) {
+  VIFLASH_Request_t *best = queue.head;
+  for(VIFLASH_Request_t *req = queue.head; NULL != req; req = req->next) {
+    uint8_t prio = effectivePrio(req);
+    uint8_t bestPrio = effectivePrio(best);
+    if((prio < bestPrio) || 
+       (prio == bestPrio && VIFLASH_PRIO_URGENT != prio && distance(req) < distance(best)))
+      best = req;
+  }
+  // requests on overlapping sectors keep their order
+  for(VIFLASH_Request_t *req = queue.head; NULL != best && req != best; ) {
+    if(conflict(req, best)) {
+      best = req;
+      req = queue.head;
+    } else {
+      req = req->next;
+    }
+  }
+  return best;
+}
+
+// erase units of a request, by their start address
+static void flashSectors(const VIFLASH_Request_t *req, size_t *first, size_t *last) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  size_t start = drv->startDiskAddress + (size_t)req->sector * drv->ffSectorSize;
+  *first = start;
+  *last = start + (size_t)req->count * drv->ffSectorSize - 1;
+  VIFLASH_FlashUnit(*first, first);
+  VIFLASH_FlashUnit(*last, last);
+}
+
+static bool inBatch(VIFLASH_Request_t **batch, uint32_t n, const VIFLASH_Request_t *req) {
+  for(uint32_t i = 0; i < n; i++) {
+    if(batch[i] == req)
+      return true;
+  }
+  return false;
+}
+
+// the picked request and the queued writes on the same flash sectors, in submission order
+static uint32_t collectBatch(VIFLASH_Request_t *pick, VIFLASH_Request_t **batch) {
+  uint32_t n = 0;
+  batch[n++] = pick;
+  // compressed sectors are not plain ranges
+  if(VIFLASH_REQ_WRITE != pick->op || 0 != VIFLASH_GetDriver()->cmpSectors)
+    return n;
+
+  size_t first, last;
+  flashSectors(pick, &first, &last);
+  for(VIFLASH_Request_t *req = queue.head; NULL != req && VIFLASH_QUEUE_MAX_MERGE > n; req = req->next) {
+    if(req == pick || VIFLASH_REQ_WRITE != req->op)
+      continue;
+    size_t reqFirst, reqLast;
+    flashSectors(req, &reqFirst, &reqLast);
+    if(reqLast < first || reqFirst > last)
+      continue;
+    bool blocked = false;
+    for(VIFLASH_Request_t *prev = queue.head; prev != req && !blocked; prev = prev->next)
+      blocked = conflict(prev, req) && !inBatch(batch, n, prev);
+    if(!blocked)
+      batch[n++] = req;
+  }
+  // later writes win where they overlap
+  for(uint32_t i = 1; i < n; i++) {
+    for(uint32_t j = i; 0 < j && batch[j - 1]->seq > batch[j]->seq; j--) {
+      VIFLASH_Request_t *req = batch[j];
+      batch[j] = batch[j - 1];
+      batch[j - 1] = req;
+    }
+  }
+  return n;
+}
+
+static void removeRequest(VIFLASH_Request_t *req) {
+  VIFLASH_Request_t *prev = NULL;
+  for(VIFLASH_Request_t *it = queue.head; NULL != it; prev = it, it = it->next) {
+    if(it != req)
+      continue;
+    if(NULL == prev)
+      queue.head = it->next;
+    else
+      prev->next = it->next;
+    if(queue.tail == it)
+      queue.tail = prev;
+    it->next = NULL;
+    queue.queued--;
+    return;
+  }
+}
+
+// ------------------------------------------------------------------------ execution
+
+static VIFLASH_Result_t serve(VIFLASH_Request_t **batch, uint32_t n) {
+  if(1 == n) {
+    if(VIFLASH_REQ_READ == batch[0]->op)
+      return VIFLASH_Read((uint8_t*)batch[0]->buff, batch[0]->sector, batch[0]->count);
+    queue.stats.rmw++;
+    return VIFLASH_Write((const uint8_t*)batch[0]->buff, batch[0]->sector, batch[0]->count);
+  }
+
+  Driver_t *drv = VIFLASH_GetDriver();
+  if(!drv->initialized)
+    return VIFLASH_RESULT_NOTRDY;
+  if(drv->writeProtected)
+    return VIFLASH_RESULT_WRPRT;
+
+  uint32_t startTick = VIFLASH_TraceTick();
+  VIFLASH_Segment_t segments[VIFLASH_QUEUE_MAX_MERGE];
+  for(uint32_t i = 0; i < n; i++) {
+    segments[i].data = (const uint8_t*)batch[i]->buff;
+    segments[i].address = drv->startDiskAddress + (size_t)batch[i]->sector * drv->ffSectorSize;
+    segments[i].size = batch[i]->count * drv->ffSectorSize;
+  }
+  if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+    drv->printfCb("Merge %d queued writes\r\n", n);
+
+  drv->writeProtected = true;
+  VIFLASH_Result_t res = VIFLASH_WriteSegments(segments, n);
+  drv->writeProtected = false;
+
+  for(uint32_t i = 0; i < n; i++) {
+    VIFLASH_TraceCall(VIFLASH_TRACE_WRITE, 0, batch[i]->sector, batch[i]->count,
+      (const uint8_t*)batch[i]->buff, res, startTick);
+  }
+  queue.stats.rmw++;
+  queue.stats.merged += n - 1;
+  return res;
+}
+
+// ------------------------------------------------------------------------ public API
+
+bool VIFLASH_QueueInit(const VIFLASH_QueueHooks_t *hooks) {
+  if(NULL != hooks && ((NULL == hooks->lock) != (NULL == hooks->unlock)))
+    return false;
+  memset(&queue, 0, sizeof(queue));
+  if(NULL != hooks)
+    queue.hooks = *hooks;
+  queue.initialized = true;
+  return true;
+}
+
+VIFLASH_Result_t VIFLASH_Submit(VIFLASH_Request_t *req) {
+  if(!queue.initialized || !VIFLASH_GetDriver()->initialized)
+    return VIFLASH_RESULT_NOTRDY;
+  if((NULL == req) || (NULL == req->buff) || (0 == req->count) ||
+     (VIFLASH_REQ_WRITE < req->op) || (VIFLASH_PRIO_BULK < req->prio) ||
+     (VIFLASH_REQ_QUEUED == req->state) ||
+     (VIFLASH_DiskSectors() < req->count) || (VIFLASH_DiskSectors() - req->count < req->sector))
+    return VIFLASH_RESULT_PARERR;
+
+  req->result = VIFLASH_RESULT_OK;
+  req->passed = 0;
+  req->next = NULL;
+  lock();
+  req->seq = queue.seq++;
+  req->state = VIFLASH_REQ_QUEUED;
+  if(NULL == queue.tail)
+    queue.head = req;
+  else
+    queue.tail->next = req;
+  queue.tail = req;
+  queue.queued++;
+  queue.stats.submitted++;
+  if(queue.queued > queue.stats.maxQueued)
+    queue.stats.maxQueued = queue.queued;
+  unlock();
+
+  if(NULL != queue.hooks.signalWorker)
+    queue.hooks.signalWorker();
+  return VIFLASH_RESULT_OK;
+}
+
+bool VIFLASH_IsDone(const VIFLASH_Request_t *req) {
+  return NULL != req && VIFLASH_REQ_DONE == req->state;
+}
+
+uint32_t VIFLASH_QueueProcess(uint32_t maxRequests) {
+  if(!queue.initialized)
+    return 0;
+
+  uint32_t served = 0;
+  while(0 == maxRequests || served < maxRequests) {
+    VIFLASH_Request_t *batch[VIFLASH_QUEUE_MAX_MERGE];
+    uint32_t n = 0;
+
+    lock();
+    VIFLASH_Request_t *pick = pickNext();
+    if(NULL != pick) {
+      n = collectBatch(pick, batch);
+      // older requests which are passed get closer to a raise
+      for(VIFLASH_Request_t *req = queue.head; req != pick; req = req->next) {
+        if(!inBatch(batch, n, req) && 0xFF != req->passed)
+          req->passed++;
+      }
+      for(uint32_t i = 0; i < n; i++)
+        removeRequest(batch[i]);
+      queue.position = pick->sector + pick->count;
+      if(VIFLASH_DiskSectors() <= queue.position)
+        queue.position = 0;
+    }
+    unlock();
+    if(0 == n)
+      break;
+
+    VIFLASH_Result_t res = serve(batch, n);
+
+    lock();
+    for(uint32_t i = 0; i < n; i++) {
+      batch[i]->result = res;
+      batch[i]->state = VIFLASH_REQ_DONE;
+    }
+    queue.stats.completed += n;
+    unlock();
+    if(NULL != queue.hooks.signalDone) {
+      for(uint32_t i = 0; i < n; i++)
+        queue.hooks.signalDone(batch[i]);
+    }
+    served += n;
+  }
+  return served;
+}
+
+void VIFLASH_QueueGetStats(VIFLASH_QueueStats_t *stats) {
+  if(NULL != stats)
+    *stats = queue.stats;
+}
@@ -0,0 +1,138 @@
+#include "viflashdrv_trace.h"
+#include "viflashdrv_private.h"
+
+#define FNV_OFFSET  0x811C9DC5U
+#define FNV_PRIME   0x01000193U
+
+static void putDword(uint8_t *buff, uint32_t value) {
+  buff[0] = (uint8_t)value;
+  buff[1] = (uint8_t)(value >> 8);
+  buff[2] = (uint8_t)(value >> 16);
+  buff[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t getDword(const uint8_t *buff) {
+  return (uint32_t)buff[0] | ((uint32_t)buff[1] << 8) |
+    ((uint32_t)buff[2] << 16) | ((uint32_t)buff[3] << 24);
+}
+
+void VIFLASH_TraceEncode(const VIFLASH_TraceRecord_t *record, uint8_t *buff) {
+  buff[0] = record->op;
+  buff[1] = record->result;
+  buff[2] = record->cmd;
+  buff[3] = record->flags;
+  putDword(buff + 4, record->sector);
+  putDword(buff + 8, record->count);
+  putDword(buff + 12, record->timestamp);
+  putDword(buff + 16, record->duration);
+  putDword(buff + 20, record->hash);
+}
+
+void VIFLASH_TraceDecode(const uint8_t *buff, VIFLASH_TraceRecord_t *record) {
+  record->op = buff[0];
+  record->result = buff[1];
+  record->cmd = buff[2];
+  record->flags = buff[3];
+  record->sector = getDword(buff + 4);
+  record->count = getDword(buff + 8);
+  record->timestamp = getDword(buff + 12);
+  record->duration = getDword(buff + 16);
+  record->hash = getDword(buff + 20);
+}
+
+uint32_t VIFLASH_TraceHash(const uint8_t *buff, uint32_t size) {
+  uint32_t hash = FNV_OFFSET;
+  for(uint32_t i = 0; i < size; i++) {
+    hash ^= buff[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+static void emit(const VIFLASH_TraceRecord_t *record) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  uint8_t buff[VIFLASH_TRACE_RECORD_SIZE];
+
+  VIFLASH_TraceEncode(record, buff);
+  if(!drv->trace.sinkCb(buff, VIFLASH_TRACE_RECORD_SIZE))
+    drv->trace.dropped++;
+}
+
+uint32_t VIFLASH_TraceTick(void) {
+  Driver_t *drv = VIFLASH_GetDriver();
+  if(NULL == drv->trace.tickCb)
+    return 0;
+  return drv->trace.tickCb();
+}
+
+bool VIFLASH_TraceStart(VIFLASH_TraceSink_t sinkCb, VIFLASH_GetTick_t tickCb,
+  uint32_t tickHz, bool hashData) {
+  Driver_t *drv = VIFLASH_GetDriver();
+
+  if(!drv->initialized || NULL == sinkCb)
+    return false;
+
+  drv->trace.sinkCb = NULL;
+  drv->trace.tickCb = tickCb;
+  drv->trace.hashData = hashData;
+  drv->trace.dropped = 0;
+
+  VIFLASH_TraceRecord_t record = {
+    /*op*/        VIFLASH_TRACE_START,
+    /*result*/    VIFLASH_RESULT_OK,
+    /*cmd*/       0,
+    /*flags*/     hashData ? VIFLASH_TRACE_FLAG_HASH : 0,
+    /*sector*/    drv->ffSectorSize,
+    /*count*/     VIFLASH_DiskSectors(),
+    /*timestamp*/ VIFLASH_TraceTick(),
+    /*duration*/  tickHz,
+    /*hash*/      VIFLASH_TRACE_MAGIC
+  };
+  drv->trace.sinkCb = sinkCb;
+  emit(&record);
+
+  if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+    drv->printfCb("Trace started\r\n");
+  return true;
+}
+
+uint32_t VIFLASH_TraceStop(void) {
+  Driver_t *drv = VIFLASH_GetDriver();
+
+  drv->trace.sinkCb = NULL;
+  drv->trace.tickCb = NULL;
+  if(VIFLASH_DEBUG_INFO <= drv->debugLvl && NULL != drv->printfCb)
+    drv->printfCb("Trace stopped; %ld records dropped\r\n", drv->trace.dropped);
+  return drv->trace.dropped;
+}
+
+void VIFLASH_TraceCall(uint8_t op, uint8_t cmd, uint32_t sector, uint32_t count,
+  const uint8_t *buff, VIFLASH_Result_t res, uint32_t startTick) {
+  Driver_t *drv = VIFLASH_GetDriver();
+
+  if(NULL == drv->trace.sinkCb)
+    return;
+
+  VIFLASH_TraceRecord_t record = {
+    /*op*/        op,
+    /*result*/    (uint8_t)res,
+    /*cmd*/       cmd,
+    /*flags*/     0,
+    /*sector*/    sector,
+    /*count*/     count,
+    /*timestamp*/ startTick,
+    /*duration*/  VIFLASH_TraceTick() - startTick,
+    /*hash*/      0
+  };
+  if(drv->trace.hashData && NULL != buff && VIFLASH_RESULT_PARERR != res) {
+    record.flags |= VIFLASH_TRACE_FLAG_HASH;
+    record.hash = VIFLASH_TraceHash(buff, count * drv->ffSectorSize);
+    // lets a replay write erased content instead of made-up data
+    uint32_t i = 0;
+    while(i < count * drv->ffSectorSize && 0xFF == buff[i])
+      i++;
+    if(count * drv->ffSectorSize == i)
+      record.flags |= VIFLASH_TRACE_FLAG_BLANK;
+  }
+  emit(&record);
+}
@@ -1,12 +1,22 @@
-#include "unity_fixture.h"
-#include "viflashdrv.h"
-
-static void runAllTests(void)
-{
-  RUN_TEST_GROUP(TST_VIFLASHDRV);
-}
-
-int main(int argc, const char* argv[])
-{
-  return UnityMain(argc, argv, runAllTests);
+#include "unity_fixture.h"
+#include "viflashdrv.h"
+
+static void runAllTests(void)
+{
+  RUN_TEST_GROUP(TST_VIFLASHDRV);
+  RUN_TEST_GROUP(TST_VIFLASHDRV_FMT);
+  RUN_TEST_GROUP(TST_VIFLASHDRV_TRACE);
+  RUN_TEST_GROUP(TST_VIFLASHDRV_KV);
+  RUN_TEST_GROUP(TST_VIFLASHDRV_CMP);
+  RUN_TEST_GROUP(TST_VIFLASHDRV_QUEUE);
+  RUN_TEST_GROUP(TST_VIFLASHDRV_IMG);
+  RUN_TEST_GROUP(TST_VIFLASHDRV_BACKEND);
+  RUN_TEST_GROUP(TST_VIFLASHDRV_DIGEST);
+  RUN_TEST_GROUP(TST_VIFLASHDRV_BLANK);
+  RUN_TEST_GROUP(TST_VIFLASHDRV_CPP);
+}
+
+int main(int argc, const char* argv[])
+{
+  return UnityMain(argc, argv, runAllTests);
 }
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include "unity.h"
+#include "unity_fixture.h"
+#include "viflashdrv.h"
+#include "viflashdrv_backend.h"
+#include "viflashdrv_kv.h"
+#include "stdio.h"
+#include "string.h"
+
+static bool FAKE_Transfer(void *context, const uint8_t *cmd, uint32_t cmdSize,
+  const uint8_t *tx, uint8_t *rx, uint32_t size);
+
+TEST_GROUP(TST_VIFLASHDRV_BACKEND);
+
+TEST_GROUP_RUNNER(TST_VIFLASHDRV_BACKEND) {
+  RUN_TEST_CASE(TST_VIFLASHDRV_BACKEND, VIFLASH_SpiNorBackend);
+  RUN_TEST_CASE(TST_VIFLASHDRV_BACKEND, VIFLASH_RamBackend);
+}
+
+#define NOR_SIZE (64*1024)
+#define NOR_PAGE_SIZE (256)
+#define NOR_ERASE_SIZE (4096)
+#define DISK_START (2*NOR_ERASE_SIZE)
+#define FFSECTOR_SIZE (512)
+#define RAM_SIZE (2048)
+#define RAM_ERASE_SIZE (512)
+
+static uint8_t norMemory[NOR_SIZE];
+static uint8_t ramMemory[RAM_SIZE];
+static uint8_t testBuff[NOR_ERASE_SIZE];
+static bool writeEnabled = false;
+static uint32_t calledEraseCounter = 0;
+static uint32_t calledProgramCounter = 0;
+
+TEST_SETUP(TST_VIFLASHDRV_BACKEND) {
+  memset(norMemory, 0xFF, sizeof(norMemory));
+  memset(ramMemory, 0xFF, sizeof(ramMemory));
+  writeEnabled = false;
+  calledEraseCounter = 0;
+  calledProgramCounter = 0;
+}
+
+TEST_TEAR_DOWN(TST_VIFLASHDRV_BACKEND) {
+  VIFLASH_InitDriver(NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, 0, 0, 0);
+}
+
+// ===================================================================================
+// Test VIFLASH_SpiNorBackend =========================================================
+TEST(TST_VIFLASHDRV_BACKEND, VIFLASH_SpiNorBackend)
+{
+  VIFLASH_SpiNor_t nor = {FAKE_Transfer, NULL, NOR_SIZE, NOR_PAGE_SIZE, NOR_ERASE_SIZE, 3};
+  VIFLASH_Backend_t backend;
+  // Test 1: wrong device description
+  {
+    VIFLASH_SpiNor_t wrong = nor;
+    wrong.eraseSize = 3000;
+    TEST_ASSERT_FALSE(VIFLASH_SpiNorBackend(&wrong, &backend));
+    wrong = nor;
+    wrong.addressBytes = 2;
+    TEST_ASSERT_FALSE(VIFLASH_SpiNorBackend(&wrong, &backend));
+    TEST_ASSERT_FALSE(VIFLASH_SpiNorBackend(NULL, &backend));
+  }
+  // Initialize driver, disk window behind two 4 KB sectors
+  {
+    TEST_ASSERT_TRUE(VIFLASH_SpiNorBackend(&nor, &backend));
+    TEST_ASSERT_FALSE(VIFLASH_InitBackend(&backend, DISK_START, DISK_START, FFSECTOR_SIZE));
+    TEST_ASSERT_TRUE(VIFLASH_InitBackend(&backend, DISK_START, NOR_SIZE, FFSECTOR_SIZE));
+    VIFLASH_SetPrintfCb(printf);
+    VIFLASH_SetDebugLvl(VIFLASH_DEBUG_INFO);
+  }
+  // Test 2: geometry of the smallest erase unit
+  {
+    uint32_t value = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Ioctl(VIFLASH_GET_SECTOR_COUNT, &value));
+    TEST_ASSERT_EQUAL_UINT32((NOR_SIZE - DISK_START)/FFSECTOR_SIZE, value);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Ioctl(VIFLASH_GET_BLOCK_SIZE, &value));
+    TEST_ASSERT_EQUAL_UINT32(NOR_ERASE_SIZE/FFSECTOR_SIZE, value);
+  }
+  // Test 3: blank flash is programmed without erase, pages do not wrap
+  {
+    for(uint32_t j = 0; j < FFSECTOR_SIZE*2; j++) {
+      testBuff[j] = j*3;
+    }
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 7, 2));
+    TEST_ASSERT_EQUAL_UINT32(0, calledEraseCounter);
+    TEST_ASSERT_EQUAL_UINT32(4, calledProgramCounter);
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, norMemory + DISK_START + 7*FFSECTOR_SIZE, FFSECTOR_SIZE*2);
+    memset(testBuff, 0, sizeof(testBuff));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Read(testBuff, 7, 2));
+    TEST_ASSERT_EQUAL_MEMORY(norMemory + DISK_START + 7*FFSECTOR_SIZE, testBuff, FFSECTOR_SIZE*2);
+  }
+  // Test 4: rewrite erases the 4 KB sector only, neighbours are kept
+  {
+    for(uint32_t j = 0; j < FFSECTOR_SIZE; j++) {
+      testBuff[j] = j;
+    }
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 8, 1));
+    TEST_ASSERT_EQUAL_UINT32(1, calledEraseCounter);
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, norMemory + DISK_START + 8*FFSECTOR_SIZE, FFSECTOR_SIZE);
+    for(uint32_t j = 0; j < FFSECTOR_SIZE; j++) {
+      TEST_ASSERT_EQUAL_UINT8((uint8_t)(j*3), norMemory[DISK_START + 7*FFSECTOR_SIZE + j]);
+    }
+  }
+  // Test 5: key/value store on 4 KB sectors in front of the disk
+  {
+    uint32_t value = 0x12345678, read = 0;
+    TEST_ASSERT_FALSE(VIFLASH_KvInit(1, 2));
+    TEST_ASSERT_TRUE(VIFLASH_KvInit(0, 2));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvSet(7, &value, sizeof(value)));
+    TEST_ASSERT_TRUE(VIFLASH_KvInit(0, 2));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvGet(7, &read, sizeof(read), NULL));
+    TEST_ASSERT_EQUAL_UINT32(value, read);
+  }
+}
+
+// ===================================================================================
+// Test VIFLASH_RamBackend ===========================================================
+TEST(TST_VIFLASHDRV_BACKEND, VIFLASH_RamBackend)
+{
+  VIFLASH_RamDisk_t ram = {ramMemory, RAM_SIZE, RAM_ERASE_SIZE};
+  VIFLASH_Backend_t backend;
+  // Test 1: wrong memory description
+  {
+    VIFLASH_RamDisk_t wrong = {ramMemory, RAM_SIZE, 300};
+    TEST_ASSERT_FALSE(VIFLASH_RamBackend(&wrong, &backend));
+    wrong.memory = NULL;
+    TEST_ASSERT_FALSE(VIFLASH_RamBackend(&wrong, &backend));
+  }
+  // Initialize driver on the whole memory
+  {
+    TEST_ASSERT_TRUE(VIFLASH_RamBackend(&ram, &backend));
+    TEST_ASSERT_TRUE(VIFLASH_InitBackend(&backend, 0, RAM_SIZE, FFSECTOR_SIZE/4));
+  }
+  // Test 2: write and read back
+  {
+    for(uint32_t j = 0; j < RAM_SIZE; j++) {
+      testBuff[j] = j + 1;
+    }
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 0, RAM_SIZE/(FFSECTOR_SIZE/4)));
+    testBuff[5] = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 0, 1));
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, ramMemory, RAM_SIZE);
+    memset(testBuff, 0, RAM_SIZE);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Read(testBuff, 1, 4));
+    TEST_ASSERT_EQUAL_MEMORY(ramMemory + FFSECTOR_SIZE/4, testBuff, FFSECTOR_SIZE);
+    uint32_t blockSize = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Ioctl(VIFLASH_GET_BLOCK_SIZE, &blockSize));
+    TEST_ASSERT_EQUAL_UINT32(RAM_ERASE_SIZE/(FFSECTOR_SIZE/4), blockSize);
+  }
+}
+
+// SPI NOR with 03h read, 02h page program, 20h sector erase and 06h/05h
+bool FAKE_Transfer(__attribute__((unused)) void *context, const uint8_t *cmd, uint32_t cmdSize,
+  const uint8_t *tx, uint8_t *rx, uint32_t size) {
+  uint32_t address = (4 == cmdSize) ? ((uint32_t)cmd[1] << 16 | (uint32_t)cmd[2] << 8 | cmd[3]) : 0;
+  switch(cmd[0]) {
+    case 0x06:
+      writeEnabled = true;
+      return true;
+    case 0x05:
+      TEST_ASSERT_EQUAL_UINT32(1, size);
+      rx[0] = 0;
+      return true;
+    case 0x03:
+      TEST_ASSERT_TRUE(address + size <= NOR_SIZE);
+      memcpy(rx, norMemory + address, size);
+      return true;
+    case 0x02:
+      TEST_ASSERT_TRUE(writeEnabled);
+      TEST_ASSERT_TRUE(address % NOR_PAGE_SIZE + size <= NOR_PAGE_SIZE);
+      for(uint32_t i = 0; i < size; i++)
+        norMemory[address + i] &= tx[i];
+      writeEnabled = false;
+      calledProgramCounter++;
+      return true;
+    case 0x20:
+      TEST_ASSERT_TRUE(writeEnabled);
+      TEST_ASSERT_EQUAL_UINT32(0, address % NOR_ERASE_SIZE);
+      memset(norMemory + address, 0xFF, NOR_ERASE_SIZE);
+      writeEnabled = false;
+      calledEraseCounter++;
+      return true;
+  }
+  return false;
+}
@@ -0,0 +1,150 @@
+#include "unity.h"
+#include "unity_fixture.h"
+#include "viflashdrv.h"
+#include "viflashdrv_blank.h"
+#include "stdio.h"
+#include "string.h"
+
+static uint32_t calledProgramCounter = 0;
+static uint32_t calledEraseCounter = 0;
+static uint32_t ticks = 0;
+static uint8_t FAKE_Program(uint32_t TypeProgram, size_t Address, uint64_t Data);
+static uint8_t FAKE_Unlock(void);
+static uint8_t FAKE_Lock(void);
+static uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError);
+static size_t FAKE_SectorToAddress(uint8_t Sector);
+static int8_t FAKE_AddressToSector(size_t Address);
+static int32_t FAKE_SectorSize(uint8_t Sector);
+static uint32_t FAKE_GetTick(void);
+
+TEST_GROUP(TST_VIFLASHDRV_BLANK);
+
+TEST_GROUP_RUNNER(TST_VIFLASHDRV_BLANK) {
+  RUN_TEST_CASE(TST_VIFLASHDRV_BLANK, VIFLASH_BlankMap);
+}
+
+// 16 FF sectors, four per flash sector
+#define FLASH_SIZE (256)
+#define FLASH_SECTOR_SIZE (64)
+#define FFSECTOR_SIZE (16)
+#define DISK_SECTORS (FLASH_SIZE/FFSECTOR_SIZE)
+
+static uint8_t testFlash[FLASH_SIZE] __attribute__((aligned(4)));
+static uint8_t testBuff[FLASH_SIZE];
+static uint32_t bitmap[VIFLASH_BLANK_WORDS(DISK_SECTORS)];
+
+TEST_SETUP(TST_VIFLASHDRV_BLANK) {
+  calledProgramCounter = 0;
+  calledEraseCounter = 0;
+  for(uint32_t i = 0; i < FLASH_SIZE; i++) {
+    testFlash[i] = 0xFF;
+    testBuff[i] = i * 5 + 1;
+  }
+  TEST_ASSERT_TRUE(VIFLASH_InitDriver(
+    FAKE_Program, FAKE_Unlock, FAKE_Lock, FAKE_EraseSector,
+    FAKE_SectorToAddress, FAKE_AddressToSector, FAKE_SectorSize,
+    (size_t)testFlash, (size_t)testFlash+FLASH_SIZE, FFSECTOR_SIZE));
+  VIFLASH_SetPrintfCb(printf);
+  VIFLASH_SetDebugLvl(VIFLASH_DEBUG_INFO);
+}
+
+TEST_TEAR_DOWN(TST_VIFLASHDRV_BLANK) {
+  VIFLASH_EnableBlankMap(NULL, 0, NULL);
+  VIFLASH_InitDriver(NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, 0, 0, 0);
+}
+
+// ===================================================================================
+// Test VIFLASH_BlankMap =============================================================
+TEST(TST_VIFLASHDRV_BLANK, VIFLASH_BlankMap)
+{
+  VIFLASH_BlankStats_t stats;
+  VIFLASH_Cost_t cost;
+  // Test 1: bitmap too small, scan finds the used sectors and is timed
+  {
+    memset(testFlash, 0, FFSECTOR_SIZE);
+    testFlash[6*FFSECTOR_SIZE + FFSECTOR_SIZE - 1] = 0x7F;
+    TEST_ASSERT_FALSE(VIFLASH_EnableBlankMap(bitmap, 0, FAKE_GetTick));
+    TEST_ASSERT_TRUE(VIFLASH_EnableBlankMap(bitmap, sizeof(bitmap)/4, FAKE_GetTick));
+    VIFLASH_BlankGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(DISK_SECTORS, stats.scanSectors);
+    TEST_ASSERT_EQUAL_UINT32(DISK_SECTORS - 2, stats.blankSectors);
+    TEST_ASSERT_EQUAL_UINT32(5, stats.scanTicks);
+  }
+  // Test 2: blank sectors are programmed directly, the estimate copies nothing
+  {
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_EstimateWrite(testBuff, 8, 2, &cost));
+    TEST_ASSERT_EQUAL_UINT32(1, cost.units);
+    TEST_ASSERT_EQUAL_UINT32(0, cost.copyBytes);
+    TEST_ASSERT_EQUAL_UINT32(2*FFSECTOR_SIZE/4, cost.words);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 8, 2));
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, testFlash + 8*FFSECTOR_SIZE, 2*FFSECTOR_SIZE);
+    TEST_ASSERT_EQUAL_UINT32(0, calledEraseCounter);
+    TEST_ASSERT_EQUAL_UINT32(2*FFSECTOR_SIZE/4, calledProgramCounter);
+    VIFLASH_BlankGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.blankWrites);
+  }
+  // Test 3: a used neighbour in the erase unit does not matter
+  {
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 5, 1));
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, testFlash + 5*FFSECTOR_SIZE, FFSECTOR_SIZE);
+    TEST_ASSERT_EQUAL_UINT8(0x7F, testFlash[6*FFSECTOR_SIZE + FFSECTOR_SIZE - 1]);
+    VIFLASH_BlankGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.blankWrites);
+  }
+  // Test 4: programmed sectors take the read-modify-write, sectors left blank
+  // after its erase are known blank again
+  {
+    testBuff[0] ^= 0xFF;
+    calledEraseCounter = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 8, 1));
+    TEST_ASSERT_EQUAL_UINT32(1, calledEraseCounter);
+    VIFLASH_BlankGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.blankWrites);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff + FFSECTOR_SIZE, 10, 2));
+    TEST_ASSERT_EQUAL_UINT32(1, calledEraseCounter);
+    VIFLASH_BlankGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.blankWrites);
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, testFlash + 8*FFSECTOR_SIZE, FFSECTOR_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(testBuff + FFSECTOR_SIZE, testFlash + 10*FFSECTOR_SIZE, 2*FFSECTOR_SIZE);
+  }
+}
+
+uint8_t FAKE_Program(__attribute__((unused)) uint32_t TypeProgram, size_t Address, uint64_t Data) {
+  calledProgramCounter++;
+  *(uint32_t*)(Address) &= (uint32_t)Data;
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Unlock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Lock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError) {
+  calledEraseCounter++;
+  for(size_t i = 0; i < Sector->NbSectors*FLASH_SECTOR_SIZE; i++)
+    testFlash[Sector->Sector*FLASH_SECTOR_SIZE+i] = 0xFF;
+  *SectorError = 0xFFFFFFFF;
+  return VIFLASH_RESULT_OK;
+}
+
+size_t FAKE_SectorToAddress(uint8_t Sector) {
+  return (size_t)testFlash+Sector*FLASH_SECTOR_SIZE;
+}
+
+int8_t FAKE_AddressToSector(size_t Address) {
+  return (Address - (size_t)testFlash)/FLASH_SECTOR_SIZE;
+}
+
+int32_t FAKE_SectorSize(__attribute__((unused)) uint8_t Sector) {
+  return FLASH_SECTOR_SIZE;
+}
+
+uint32_t FAKE_GetTick(void) {
+  ticks += 5;
+  return ticks;
+}
@@ -0,0 +1,257 @@
+#include "unity.h"
+#include "unity_fixture.h"
+#include "viflashdrv.h"
+#include "viflashdrv_cmp.h"
+#include "stdio.h"
+#include "string.h"
+
+static uint32_t calledProgramCounter = 0;
+static uint32_t calledEraseCounter = 0;
+static uint8_t FAKE_Program(uint32_t TypeProgram, size_t Address, uint64_t Data);
+static uint8_t FAKE_Unlock(void);
+static uint8_t FAKE_Lock(void);
+static uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError);
+static size_t FAKE_SectorToAddress(uint8_t Sector);
+static int8_t FAKE_AddressToSector(size_t Address);
+static int32_t FAKE_SectorSize(uint8_t Sector);
+
+TEST_GROUP(TST_VIFLASHDRV_CMP);
+
+TEST_GROUP_RUNNER(TST_VIFLASHDRV_CMP) {
+  RUN_TEST_CASE(TST_VIFLASHDRV_CMP, VIFLASH_Compression);
+}
+
+// four erase units of 256 B; 24 sectors overcommitted, the plain layout has 16
+// and 6 raw records fit besides the head and the free unit
+#define FLASH_SIZE (1024)
+#define FLASH_SECTOR_SIZE (256)
+#define FFSECTOR_SIZE (64)
+#define DISK_SECTORS (24)
+#define SAFE_SECTORS (6)
+
+static uint8_t testFlash[FLASH_SIZE] __attribute__((aligned(4)));
+static uint8_t testBuff[2*FFSECTOR_SIZE];
+static uint8_t readBuff[2*FFSECTOR_SIZE];
+
+static void fillText(uint8_t *buff, uint32_t size, uint32_t seed) {
+  snprintf((char*)buff, size, "%08lu viflashdrv viflashdrv viflashdrv viflashdrv viflashdrv", 
+    (unsigned long)seed);
+}
+
+static void fillRandom(uint8_t *buff, uint32_t size, uint32_t seed) {
+  for(uint32_t i = 0; i < size; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    buff[i] = seed;
+  }
+}
+
+TEST_SETUP(TST_VIFLASHDRV_CMP) {
+  calledProgramCounter = 0;
+  calledEraseCounter = 0;
+  for(uint32_t i = 0; i < FLASH_SIZE; i++) {
+    testFlash[i] = 0xFF;
+  }
+  TEST_ASSERT_TRUE(VIFLASH_InitDriver(
+    FAKE_Program, FAKE_Unlock, FAKE_Lock, FAKE_EraseSector,
+    FAKE_SectorToAddress, FAKE_AddressToSector, FAKE_SectorSize,
+    (size_t)testFlash, (size_t)testFlash+FLASH_SIZE, FFSECTOR_SIZE));
+  VIFLASH_SetPrintfCb(printf);
+  VIFLASH_SetDebugLvl(VIFLASH_DEBUG_INFO);
+}
+
+TEST_TEAR_DOWN(TST_VIFLASHDRV_CMP) {
+  VIFLASH_EnableCompression(0, false);
+  VIFLASH_InitDriver(NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, 0, 0, 0);
+}
+
+// ===================================================================================
+// Test VIFLASH_Compression ==========================================================
+TEST(TST_VIFLASHDRV_CMP, VIFLASH_Compression)
+{
+  VIFLASH_CmpStats_t stats;
+  // Test 1: wrong parameters, disk offers the requested sectors
+  {
+    TEST_ASSERT_FALSE(VIFLASH_EnableCompression(FLASH_SIZE, true));
+    TEST_ASSERT_TRUE(VIFLASH_EnableCompression(DISK_SECTORS, true));
+    uint32_t value = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Ioctl(VIFLASH_GET_SECTOR_COUNT, &value));
+    TEST_ASSERT_EQUAL_UINT32(DISK_SECTORS, value);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Ioctl(VIFLASH_GET_BLOCK_SIZE, &value));
+    TEST_ASSERT_EQUAL_UINT32(1, value);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_Write(testBuff, DISK_SECTORS, 1));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_Read(readBuff, DISK_SECTORS - 1, 2));
+  }
+  // Test 2: blank and one-value sectors cost no payload
+  {
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Read(readBuff, 0, 1));
+    memset(testBuff, 0xFF, FFSECTOR_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, readBuff, FFSECTOR_SIZE);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 0, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, calledProgramCounter);
+
+    // unit header (2 words) and the record (3 words)
+    memset(testBuff, 0x00, FFSECTOR_SIZE);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 0, 1));
+    TEST_ASSERT_EQUAL_UINT32(5, calledProgramCounter);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Read(readBuff, 0, 1));
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, readBuff, FFSECTOR_SIZE);
+  }
+  // Test 3: compressible sector, an unchanged one is skipped
+  {
+    calledProgramCounter = 0;
+    fillText(testBuff, FFSECTOR_SIZE, 1);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 1, 1));
+    TEST_ASSERT_TRUE(FFSECTOR_SIZE/4 > calledProgramCounter);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Read(readBuff, 1, 1));
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, readBuff, FFSECTOR_SIZE);
+    calledProgramCounter = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 1, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, calledProgramCounter);
+  }
+  // Test 4: equal header and checksum are not enough, the payload is compared
+  {
+    uint32_t *record = (uint32_t*)testFlash;
+    while(0x00000001 != record[1] || 0xC5 != (record[0] & 0xFF))
+      record++;
+    ((uint8_t*)record)[13] &= 0x0F;
+    calledProgramCounter = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 1, 1));
+    TEST_ASSERT_TRUE(0 < calledProgramCounter);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Read(readBuff, 1, 1));
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, readBuff, FFSECTOR_SIZE);
+  }
+  // Test 5: incompressible sector is stored as is
+  {
+    fillRandom(testBuff, FFSECTOR_SIZE, 1);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 2, 1));
+    VIFLASH_CmpGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.rawSectors);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Read(readBuff, 2, 1));
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, readBuff, FFSECTOR_SIZE);
+  }
+  // Test 6: more sectors than the plain layout, updates reclaim outdated units
+  {
+    calledEraseCounter = 0;
+    memset(testBuff, 0x00, FFSECTOR_SIZE);
+    for(uint32_t sector = 12; sector < DISK_SECTORS; sector++)
+      TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, sector, 1));
+    for(uint32_t round = 0; round < 10; round++) {
+      for(uint32_t sector = 0; sector < 12; sector++) {
+        fillText(testBuff, FFSECTOR_SIZE, round * 100 + sector);
+        TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, sector, 1));
+      }
+    }
+    VIFLASH_CmpGetStats(&stats);
+    TEST_ASSERT_TRUE(0 < stats.collections);
+    TEST_ASSERT_EQUAL_UINT32(stats.collections, calledEraseCounter);
+    // the plain layout erases once per update
+    TEST_ASSERT_TRUE(10*12/2 > calledEraseCounter);
+    for(uint32_t sector = 0; sector < DISK_SECTORS; sector++) {
+      if(12 > sector)
+        fillText(testBuff, FFSECTOR_SIZE, 900 + sector);
+      else
+        memset(testBuff, 0x00, FFSECTOR_SIZE);
+      TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Read(readBuff, sector, 1));
+      TEST_ASSERT_EQUAL_MEMORY(testBuff, readBuff, FFSECTOR_SIZE);
+    }
+  }
+  // Test 7: index is rebuilt from flash, torn records are ignored
+  {
+    uint32_t *tail = NULL;
+    for(uint32_t unit = 0; unit < FLASH_SIZE/FLASH_SECTOR_SIZE; unit++) {
+      uint32_t *words = (uint32_t*)(testFlash + unit * FLASH_SECTOR_SIZE);
+      if(NULL == tail || words[1] > tail[1])
+        tail = words;
+    }
+    while(0xFFFFFFFF != *tail)
+      tail++;
+    tail[0] = 0x001003C5;
+    tail[1] = 0x00000003;
+    TEST_ASSERT_TRUE(VIFLASH_EnableCompression(DISK_SECTORS, true));
+    for(uint32_t sector = 0; sector < 12; sector++) {
+      fillText(testBuff, FFSECTOR_SIZE, 900 + sector);
+      TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Read(readBuff, sector, 1));
+      TEST_ASSERT_EQUAL_MEMORY(testBuff, readBuff, FFSECTOR_SIZE);
+    }
+    // the torn record stays, the next one goes behind it
+    fillText(testBuff, FFSECTOR_SIZE, 1000);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 3, 1));
+    TEST_ASSERT_EQUAL_UINT32(0x001003C5, tail[0]);
+    TEST_ASSERT_TRUE(VIFLASH_EnableCompression(DISK_SECTORS, true));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Read(readBuff, 3, 1));
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, readBuff, FFSECTOR_SIZE);
+    // record which cannot be decoded
+    uint32_t *record = (uint32_t*)testFlash;
+    while(0x00000005 != record[1] || 0xC5 != (record[0] & 0xFF))
+      record++;
+    record[0] = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_ERROR == VIFLASH_Read(readBuff, 5, 1));
+  }
+  // Test 8: data which does not compress fills the disk
+  {
+    VIFLASH_Result_t res = VIFLASH_RESULT_OK;
+    for(uint32_t sector = 0; VIFLASH_RESULT_OK == res && sector < DISK_SECTORS; sector++) {
+      fillRandom(testBuff, FFSECTOR_SIZE, sector + 1);
+      res = VIFLASH_Write(testBuff, sector, 1);
+    }
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_ERROR == res);
+  }
+  // Test 9: without overcommit the disk is limited to what fits uncompressed
+  {
+    TEST_ASSERT_TRUE(VIFLASH_EnableCompression(0, false));
+    for(uint32_t i = 0; i < FLASH_SIZE; i++)
+      testFlash[i] = 0xFF;
+    TEST_ASSERT_TRUE(VIFLASH_EnableCompression(DISK_SECTORS, false));
+    uint32_t value = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Ioctl(VIFLASH_GET_SECTOR_COUNT, &value));
+    TEST_ASSERT_EQUAL_UINT32(SAFE_SECTORS, value);
+    for(uint32_t round = 0; round < 4; round++) {
+      for(uint32_t sector = 0; sector < SAFE_SECTORS; sector++) {
+        fillRandom(testBuff, FFSECTOR_SIZE, 100 * round + sector + 1);
+        TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, sector, 1));
+      }
+    }
+    for(uint32_t sector = 0; sector < SAFE_SECTORS; sector++) {
+      fillRandom(testBuff, FFSECTOR_SIZE, 300 + sector + 1);
+      TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Read(readBuff, sector, 1));
+      TEST_ASSERT_EQUAL_MEMORY(testBuff, readBuff, FFSECTOR_SIZE);
+    }
+  }
+}
+
+uint8_t FAKE_Program(__attribute__((unused)) uint32_t TypeProgram, size_t Address, uint64_t Data) {
+  calledProgramCounter++;
+  *(uint32_t*)(Address) &= (uint32_t)Data;
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Unlock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Lock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError) {
+  calledEraseCounter++;
+  for(size_t i = 0; i < Sector->NbSectors*FLASH_SECTOR_SIZE; i++)
+    testFlash[Sector->Sector*FLASH_SECTOR_SIZE+i] = 0xFF;
+  *SectorError = 0xFFFFFFFF;
+  return VIFLASH_RESULT_OK;
+}
+
+size_t FAKE_SectorToAddress(uint8_t Sector) {
+  return (size_t)testFlash+Sector*FLASH_SECTOR_SIZE;
+}
+
+int8_t FAKE_AddressToSector(size_t Address) {
+  return (Address - (size_t)testFlash)/FLASH_SECTOR_SIZE;
+}
+
+int32_t FAKE_SectorSize(__attribute__((unused)) uint8_t Sector) {
+  return FLASH_SECTOR_SIZE;
+}
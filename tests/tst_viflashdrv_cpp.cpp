@@ -0,0 +1,189 @@
+#include "unity.h"
+#include "unity_fixture.h"
+#include "viflashdrv.hpp"
+#include "stdio.h"
+#include "string.h"
+
+// disk window of four flash sectors with different sizes
+#define FLASH_SIZE (512)
+#define FFSECTOR_SIZE (32)
+
+static uint8_t testFlash[FLASH_SIZE] __attribute__((aligned(8)));
+static uint8_t refFlash[FLASH_SIZE] __attribute__((aligned(8)));
+static uint8_t testBuff[4*FFSECTOR_SIZE];
+static uint8_t readBuff[4*FFSECTOR_SIZE];
+static uint32_t calledProgramCounter = 0;
+static uint32_t calledEraseCounter = 0;
+
+using TestGeometry = viflash::Geometry<0, 64, 64, 128, 256>;
+
+struct TestHal {
+  static std::uintptr_t address(std::uint8_t sector) {
+    return reinterpret_cast<std::uintptr_t>(testFlash) + TestGeometry::offsets[sector];
+  }
+  static bool unlock() {
+    return true;
+  }
+  static void lock() {
+  }
+  static bool erase(std::uint8_t sector) {
+    calledEraseCounter++;
+    memset(testFlash + TestGeometry::offsets[sector], 0xFF, TestGeometry::sizes[sector]);
+    return true;
+  }
+  template <typename Word>
+  static bool program(std::uintptr_t address, Word data) {
+    calledProgramCounter++;
+    Word word;
+    memcpy(&word, reinterpret_cast<void*>(address), sizeof(word));
+    word &= data;
+    memcpy(reinterpret_cast<void*>(address), &word, sizeof(word));
+    return true;
+  }
+};
+
+using TestDisk = viflash::Disk<TestGeometry, FFSECTOR_SIZE, 4, TestHal>;
+using TestDisk64 = viflash::Disk<TestGeometry, FFSECTOR_SIZE, 8, TestHal>;
+
+static_assert(16 == TestDisk::sectorCount, "sector count is folded at compile time");
+static_assert(2 == TestDisk::blockSize, "block size is folded at compile time");
+static_assert(2 == TestGeometry::indexOf(3*FFSECTOR_SIZE + 64), "sector lookup is folded at compile time");
+
+// C driver on the same geometry, for the layout comparison
+static uint8_t REF_Program(uint32_t TypeProgram, size_t Address, uint64_t Data);
+static uint8_t REF_Unlock(void);
+static uint8_t REF_Lock(void);
+static uint8_t REF_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError);
+static size_t REF_SectorToAddress(uint8_t Sector);
+static int8_t REF_AddressToSector(size_t Address);
+static int32_t REF_SectorSize(uint8_t Sector);
+
+extern "C" void TEST_TST_VIFLASHDRV_CPP_GROUP_RUNNER(void);
+
+TEST_GROUP(TST_VIFLASHDRV_CPP);
+
+TEST_GROUP_RUNNER(TST_VIFLASHDRV_CPP) {
+  RUN_TEST_CASE(TST_VIFLASHDRV_CPP, VIFLASH_Disk);
+}
+
+TEST_SETUP(TST_VIFLASHDRV_CPP) {
+  calledProgramCounter = 0;
+  calledEraseCounter = 0;
+  memset(testFlash, 0xFF, FLASH_SIZE);
+  memset(refFlash, 0xFF, FLASH_SIZE);
+}
+
+TEST_TEAR_DOWN(TST_VIFLASHDRV_CPP) {
+  VIFLASH_InitDriver(NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, 0, 0, 0);
+}
+
+// ===================================================================================
+// Test viflash::Disk ================================================================
+TEST(TST_VIFLASHDRV_CPP, VIFLASH_Disk)
+{
+  TestDisk disk;
+  TEST_ASSERT_TRUE(VIFLASH_InitDriver(
+    REF_Program, REF_Unlock, REF_Lock, REF_EraseSector,
+    REF_SectorToAddress, REF_AddressToSector, REF_SectorSize,
+    (size_t)refFlash, (size_t)refFlash+FLASH_SIZE, FFSECTOR_SIZE));
+
+  // Test 1: wrong parameters and ioctl
+  {
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == disk.write(NULL, 0, 1));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == disk.write(testBuff, 0, 0));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == disk.write(testBuff, TestDisk::sectorCount - 1, 2));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == disk.read(readBuff, TestDisk::sectorCount, 1));
+    uint32_t value = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == disk.ioctl(VIFLASH_GET_SECTOR_COUNT, &value));
+    TEST_ASSERT_EQUAL_UINT32(FLASH_SIZE/FFSECTOR_SIZE, value);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == disk.ioctl(VIFLASH_GET_BLOCK_SIZE, &value));
+    uint32_t refValue = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Ioctl(VIFLASH_GET_BLOCK_SIZE, &refValue));
+    TEST_ASSERT_EQUAL_UINT32(refValue, value);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == disk.ioctl(VIFLASH_GET_SECTOR_SIZE, NULL));
+    TEST_ASSERT_FALSE(disk.isWriteProtected());
+  }
+  // Test 2: write to blank flash programs words only
+  {
+    for(uint32_t j = 0; j < sizeof(testBuff); j++)
+      testBuff[j] = j;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == disk.write(testBuff, 1, 4));
+    TEST_ASSERT_EQUAL_UINT32(0, calledEraseCounter);
+    TEST_ASSERT_EQUAL_UINT32(4*FFSECTOR_SIZE/4, calledProgramCounter);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == disk.read(readBuff, 1, 4));
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, readBuff, sizeof(testBuff));
+    // unchanged data costs nothing
+    calledProgramCounter = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == disk.write(testBuff, 1, 4));
+    TEST_ASSERT_EQUAL_UINT32(0, calledProgramCounter);
+  }
+  // Test 3: changed data erases the touched flash sectors only, neighbours survive
+  {
+    memset(testBuff, 0x5A, FFSECTOR_SIZE);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == disk.write(testBuff, 2, 1));
+    TEST_ASSERT_EQUAL_UINT32(1, calledEraseCounter);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == disk.read(readBuff, 1, 4));
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, readBuff + FFSECTOR_SIZE, FFSECTOR_SIZE);
+    for(uint32_t j = 0; j < FFSECTOR_SIZE; j++) {
+      TEST_ASSERT_EQUAL_UINT8(j, readBuff[j]);
+      TEST_ASSERT_EQUAL_UINT8(3*FFSECTOR_SIZE + j, readBuff[3*FFSECTOR_SIZE + j]);
+    }
+  }
+  // Test 4: 64-bit program width
+  {
+    TestDisk64 disk64;
+    calledProgramCounter = 0;
+    memset(testBuff, 0x00, FFSECTOR_SIZE);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == disk64.write(testBuff, 15, 1));
+    TEST_ASSERT_EQUAL_UINT32(FFSECTOR_SIZE/8, calledProgramCounter);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == disk64.read(readBuff, 15, 1));
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, readBuff, FFSECTOR_SIZE);
+  }
+  // Test 5: same flash image as the C driver
+  {
+    memset(testFlash, 0xFF, FLASH_SIZE);
+    for(uint32_t i = 0; i < 20; i++) {
+      uint32_t sector = (i * 7) % TestDisk::sectorCount;
+      uint32_t count = 1 + i % 3;
+      if(TestDisk::sectorCount < sector + count)
+        count = TestDisk::sectorCount - sector;
+      for(uint32_t j = 0; j < count*FFSECTOR_SIZE; j++)
+        testBuff[j % sizeof(testBuff)] = (i & 1) ? 0xFF : (uint8_t)(i * 31 + j);
+      TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == disk.write(testBuff, sector, count));
+      TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, sector, count));
+    }
+    TEST_ASSERT_EQUAL_MEMORY(refFlash, testFlash, FLASH_SIZE);
+  }
+}
+
+uint8_t REF_Program(__attribute__((unused)) uint32_t TypeProgram, size_t Address, uint64_t Data) {
+  *(uint32_t*)(Address) &= (uint32_t)Data;
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t REF_Unlock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t REF_Lock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t REF_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError) {
+  memset(refFlash + TestGeometry::offsets[Sector->Sector], 0xFF, TestGeometry::sizes[Sector->Sector]);
+  *SectorError = 0xFFFFFFFF;
+  return VIFLASH_RESULT_OK;
+}
+
+size_t REF_SectorToAddress(uint8_t Sector) {
+  return (size_t)refFlash + TestGeometry::offsets[Sector];
+}
+
+int8_t REF_AddressToSector(size_t Address) {
+  return TestGeometry::indexOf(Address - (size_t)refFlash);
+}
+
+int32_t REF_SectorSize(uint8_t Sector) {
+  return TestGeometry::sizes[Sector];
+}
@@ -0,0 +1,194 @@
+#include "unity.h"
+#include "unity_fixture.h"
+#include "viflashdrv.h"
+#include "viflashdrv_digest.h"
+#include "viflashdrv_queue.h"
+#include "stdio.h"
+#include "string.h"
+
+static uint32_t calledProgramCounter = 0;
+static uint32_t calledUnlockCounter = 0;
+static uint32_t calledEraseCounter = 0;
+static uint8_t FAKE_Program(uint32_t TypeProgram, size_t Address, uint64_t Data);
+static uint8_t FAKE_Unlock(void);
+static uint8_t FAKE_Lock(void);
+static uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError);
+static size_t FAKE_SectorToAddress(uint8_t Sector);
+static int8_t FAKE_AddressToSector(size_t Address);
+static int32_t FAKE_SectorSize(uint8_t Sector);
+
+TEST_GROUP(TST_VIFLASHDRV_DIGEST);
+
+TEST_GROUP_RUNNER(TST_VIFLASHDRV_DIGEST) {
+  RUN_TEST_CASE(TST_VIFLASHDRV_DIGEST, VIFLASH_Digest);
+}
+
+// 16 FF sectors, four per flash sector
+#define FLASH_SIZE (256)
+#define FLASH_SECTOR_SIZE (64)
+#define FFSECTOR_SIZE (16)
+#define DISK_SECTORS (FLASH_SIZE/FFSECTOR_SIZE)
+
+static uint8_t testFlash[FLASH_SIZE] __attribute__((aligned(4)));
+static uint8_t testBuff[FLASH_SIZE];
+static uint32_t digestTable[VIFLASH_DIGEST_WORDS(DISK_SECTORS)];
+
+static void resetCounters(void) {
+  calledProgramCounter = 0;
+  calledUnlockCounter = 0;
+  calledEraseCounter = 0;
+}
+
+TEST_SETUP(TST_VIFLASHDRV_DIGEST) {
+  resetCounters();
+  for(uint32_t i = 0; i < FLASH_SIZE; i++) {
+    testFlash[i] = 0xFF;
+    testBuff[i] = i * 5 + 1;
+  }
+  TEST_ASSERT_TRUE(VIFLASH_InitDriver(
+    FAKE_Program, FAKE_Unlock, FAKE_Lock, FAKE_EraseSector,
+    FAKE_SectorToAddress, FAKE_AddressToSector, FAKE_SectorSize,
+    (size_t)testFlash, (size_t)testFlash+FLASH_SIZE, FFSECTOR_SIZE));
+  VIFLASH_SetPrintfCb(printf);
+  VIFLASH_SetDebugLvl(VIFLASH_DEBUG_INFO);
+}
+
+TEST_TEAR_DOWN(TST_VIFLASHDRV_DIGEST) {
+  VIFLASH_EnableDigest(NULL, 0, false);
+  VIFLASH_InitDriver(NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, 0, 0, 0);
+}
+
+// ===================================================================================
+// Test VIFLASH_Digest ===============================================================
+TEST(TST_VIFLASHDRV_DIGEST, VIFLASH_Digest)
+{
+  VIFLASH_DigestStats_t stats;
+  // Test 1: table too small
+  {
+    TEST_ASSERT_FALSE(VIFLASH_EnableDigest(digestTable, DISK_SECTORS, false));
+    TEST_ASSERT_TRUE(VIFLASH_EnableDigest(digestTable, sizeof(digestTable)/4, false));
+  }
+  // Test 2: written sectors are known, an equal rewrite does not touch the flash
+  {
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 0, 3));
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, testFlash, 3*FFSECTOR_SIZE);
+    resetCounters();
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 0, 3));
+    TEST_ASSERT_EQUAL_UINT32(0, calledUnlockCounter + calledProgramCounter + calledEraseCounter);
+    VIFLASH_DigestGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.written);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.skipped);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.invalidated);
+  }
+  // Test 3: equal sectors at both ends are left out
+  {
+    testBuff[FFSECTOR_SIZE] ^= 0xFF;
+    resetCounters();
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 0, 3));
+    TEST_ASSERT_EQUAL_MEMORY(testBuff, testFlash, 3*FFSECTOR_SIZE);
+    TEST_ASSERT_EQUAL_UINT32(1, calledEraseCounter);
+    VIFLASH_DigestGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.written);
+    TEST_ASSERT_EQUAL_UINT32(5, stats.skipped);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.invalidated);
+  }
+  // Test 4: table built by reads, unknown sectors go to the read-modify-write
+  {
+    uint8_t readBuff[FFSECTOR_SIZE];
+    TEST_ASSERT_TRUE(VIFLASH_EnableDigest(digestTable, sizeof(digestTable)/4, false));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Read(readBuff, 0, 1));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 0, 1));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff + FFSECTOR_SIZE, 1, 1));
+    VIFLASH_DigestGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.learned);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.skipped);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.written);
+  }
+  // Test 5: table built by a scan of the disk
+  {
+    TEST_ASSERT_TRUE(VIFLASH_EnableDigest(digestTable, sizeof(digestTable)/4, true));
+    VIFLASH_DigestGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(DISK_SECTORS, stats.learned);
+    memcpy(testBuff + 3*FFSECTOR_SIZE, testFlash + 3*FFSECTOR_SIZE, FLASH_SIZE - 3*FFSECTOR_SIZE);
+    resetCounters();
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 0, DISK_SECTORS));
+    TEST_ASSERT_EQUAL_UINT32(0, calledUnlockCounter);
+  }
+  // Test 6: merged queue writes drop the digests of their sectors
+  {
+    VIFLASH_Request_t requests[2];
+    memset(requests, 0, sizeof(requests));
+    TEST_ASSERT_TRUE(VIFLASH_QueueInit(NULL));
+    for(uint32_t i = 0; i < 2; i++) {
+      requests[i].op = VIFLASH_REQ_WRITE;
+      requests[i].prio = VIFLASH_PRIO_NORMAL;
+      requests[i].buff = testBuff + (4 + i)*FFSECTOR_SIZE;
+      requests[i].sector = 4 + i;
+      requests[i].count = 1;
+      TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Submit(&requests[i]));
+    }
+    testBuff[4*FFSECTOR_SIZE] = 0x11;
+    testBuff[5*FFSECTOR_SIZE] = 0x22;
+    TEST_ASSERT_EQUAL_UINT32(2, VIFLASH_QueueProcess(0));
+    TEST_ASSERT_EQUAL_UINT8(0x22, testFlash[5*FFSECTOR_SIZE]);
+    VIFLASH_DigestGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.invalidated);
+    uint32_t written = stats.written;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff + 4*FFSECTOR_SIZE, 4, 2));
+    VIFLASH_DigestGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(written + 2, stats.written);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff + 4*FFSECTOR_SIZE, 4, 2));
+    VIFLASH_DigestGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(written + 2, stats.written);
+  }
+  // Test 7: the estimate leaves out the same sectors as the write
+  {
+    VIFLASH_Cost_t cost;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_EstimateWrite(testBuff, 0, 4, &cost));
+    TEST_ASSERT_EQUAL_UINT32(0, cost.units);
+    TEST_ASSERT_EQUAL_UINT32(0, cost.timeUs);
+    testBuff[FFSECTOR_SIZE] ^= 0xFF;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_EstimateWrite(testBuff, 0, 8, &cost));
+    TEST_ASSERT_EQUAL_UINT32(1, cost.units);
+    TEST_ASSERT_EQUAL_UINT32(1, cost.erases);
+    resetCounters();
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 0, 8));
+    TEST_ASSERT_EQUAL_UINT32(1, calledEraseCounter);
+  }
+}
+
+uint8_t FAKE_Program(__attribute__((unused)) uint32_t TypeProgram, size_t Address, uint64_t Data) {
+  calledProgramCounter++;
+  *(uint32_t*)(Address) &= (uint32_t)Data;
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Unlock(void) {
+  calledUnlockCounter++;
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Lock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError) {
+  calledEraseCounter++;
+  for(size_t i = 0; i < Sector->NbSectors*FLASH_SECTOR_SIZE; i++)
+    testFlash[Sector->Sector*FLASH_SECTOR_SIZE+i] = 0xFF;
+  *SectorError = 0xFFFFFFFF;
+  return VIFLASH_RESULT_OK;
+}
+
+size_t FAKE_SectorToAddress(uint8_t Sector) {
+  return (size_t)testFlash+Sector*FLASH_SECTOR_SIZE;
+}
+
+int8_t FAKE_AddressToSector(size_t Address) {
+  return (Address - (size_t)testFlash)/FLASH_SECTOR_SIZE;
+}
+
+int32_t FAKE_SectorSize(__attribute__((unused)) uint8_t Sector) {
+  return FLASH_SECTOR_SIZE;
+}
@@ -0,0 +1,227 @@
+#include "unity.h"
+#include "unity_fixture.h"
+#include "viflashdrv.h"
+#include "viflashdrv_fmt.h"
+#include "stdio.h"
+
+static uint32_t calledEraseCounter = 0;
+static uint8_t FAKE_Program(uint32_t TypeProgram, size_t Address, uint64_t Data);
+static uint8_t FAKE_Unlock(void);
+static uint8_t FAKE_Lock(void);
+static uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError);
+static size_t FAKE_SectorToAddress(uint8_t Sector);
+static int8_t FAKE_AddressToSector(size_t Address);
+static int32_t FAKE_SectorSize(uint8_t Sector);
+
+TEST_GROUP(TST_VIFLASHDRV_FMT);
+
+TEST_GROUP_RUNNER(TST_VIFLASHDRV_FMT) {
+  RUN_TEST_CASE(TST_VIFLASHDRV_FMT, VIFLASH_ComputeFormat);
+  RUN_TEST_CASE(TST_VIFLASHDRV_FMT, VIFLASH_FormatVolume);
+}
+
+// Scaled down STM32F4 layout: 4 small, 1 medium and 2 big sectors
+#define FLASH_SECTORS (7)
+#define FLASH_SIZE (96*1024)
+#define FFSECTOR_SIZE (512)
+
+static const uint32_t f4SectorSizes[FLASH_SECTORS] = {
+  4096, 4096, 4096, 4096, 16384, 32768, 32768
+};
+
+// Enough clusters for the FAT12/16 boundary: 3 tiny sectors, then 17 uniform ones
+#define WIDE_SECTORS (20)
+#define WIDE_SIZE (512 + 17*32768)
+#define WIDE_FFSECTOR_SIZE (64)
+
+static const uint32_t wideSectorSizes[WIDE_SECTORS] = {
+  256, 128, 128, 32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768,
+  32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768
+};
+
+static const uint32_t *sectorSizes = f4SectorSizes;
+static uint8_t flashSectors = FLASH_SECTORS;
+static uint8_t testFlash[WIDE_SIZE] __attribute__((aligned(4)));
+
+static bool initWide(size_t start, uint32_t ffSectors) {
+  sectorSizes = wideSectorSizes;
+  flashSectors = WIDE_SECTORS;
+  return VIFLASH_InitDriver(
+    FAKE_Program, FAKE_Unlock, FAKE_Lock, FAKE_EraseSector,
+    FAKE_SectorToAddress, FAKE_AddressToSector, FAKE_SectorSize,
+    (size_t)testFlash + start, (size_t)testFlash + start + ffSectors*WIDE_FFSECTOR_SIZE,
+    WIDE_FFSECTOR_SIZE);
+}
+
+TEST_SETUP(TST_VIFLASHDRV_FMT) {
+  calledEraseCounter = 0;
+  sectorSizes = f4SectorSizes;
+  flashSectors = FLASH_SECTORS;
+  for(uint32_t i = 0; i < FLASH_SIZE; i++) {
+    testFlash[i] = 0xFF;
+  }
+  TEST_ASSERT_TRUE(VIFLASH_InitDriver(
+    FAKE_Program, FAKE_Unlock, FAKE_Lock, FAKE_EraseSector,
+    FAKE_SectorToAddress, FAKE_AddressToSector, FAKE_SectorSize,
+    (size_t)testFlash, (size_t)testFlash+FLASH_SIZE, FFSECTOR_SIZE));
+  VIFLASH_SetPrintfCb(printf);
+  VIFLASH_SetDebugLvl(VIFLASH_DEBUG_INFO);
+}
+
+TEST_TEAR_DOWN(TST_VIFLASHDRV_FMT) {
+  VIFLASH_InitDriver(NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, 0, 0, 0);
+}
+
+// ===================================================================================
+// Test VIFLASH_ComputeFormat ========================================================
+TEST(TST_VIFLASHDRV_FMT, VIFLASH_ComputeFormat)
+{
+  VIFLASH_Format_t fmt;
+  // Test 1: wrong parameters
+  {
+    TEST_ASSERT_FALSE(VIFLASH_ComputeFormat(2, 64, NULL));
+    TEST_ASSERT_FALSE(VIFLASH_ComputeFormat(0, 64, &fmt));
+  }
+  // Test 2: block size is the smallest erase sector of the disk
+  {
+    uint32_t blockSize = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK ==
+      VIFLASH_Ioctl(VIFLASH_GET_BLOCK_SIZE, &blockSize));
+    TEST_ASSERT_EQUAL_UINT32(4096/FFSECTOR_SIZE, blockSize);
+  }
+  // Test 3: boot sector already in a small sector keeps the FAT behind it,
+  // data on an erase boundary
+  {
+    TEST_ASSERT_TRUE(VIFLASH_ComputeFormat(2, 64, &fmt));
+    TEST_ASSERT_EQUAL_UINT32(12, fmt.fatType);
+    TEST_ASSERT_EQUAL_UINT32(192, fmt.totalSectors);
+    TEST_ASSERT_EQUAL_UINT32(8, fmt.clusterSize);
+    TEST_ASSERT_EQUAL_UINT32(1, fmt.reservedSectors);
+    TEST_ASSERT_EQUAL_UINT32(1, fmt.fatSectors);
+    TEST_ASSERT_EQUAL_UINT32(5, fmt.rootDirSectors);
+    TEST_ASSERT_EQUAL_UINT32(8, fmt.dataStartSector);
+    TEST_ASSERT_EQUAL_UINT32(23, fmt.clusterCount);
+    TEST_ASSERT_EQUAL_UINT32(4096, fmt.fatEraseSize);
+    TEST_ASSERT_EQUAL_UINT32((3*4096 + 4*16384 + 16*32768)/23, fmt.dataEraseSize);
+    TEST_ASSERT_EQUAL_UINT32(fmt.fatEraseSize + fmt.dataEraseSize, fmt.eraseCostPerClusterWrite);
+  }
+  // Test 4: disk window starting inside the medium sector keeps the FAT in place
+  {
+    TEST_ASSERT_TRUE(VIFLASH_InitDriver(
+      FAKE_Program, FAKE_Unlock, FAKE_Lock, FAKE_EraseSector,
+      FAKE_SectorToAddress, FAKE_AddressToSector, FAKE_SectorSize,
+      (size_t)testFlash+24576, (size_t)testFlash+FLASH_SIZE, FFSECTOR_SIZE));
+    TEST_ASSERT_TRUE(VIFLASH_ComputeFormat(1, 16, &fmt));
+    TEST_ASSERT_EQUAL_UINT32(1, fmt.reservedSectors);
+    TEST_ASSERT_EQUAL_UINT32(16, fmt.dataStartSector);
+    TEST_ASSERT_EQUAL_UINT32(8, fmt.clusterSize);
+    TEST_ASSERT_EQUAL_UINT32(16, fmt.clusterCount);
+  }
+  // Test 5: uniform erase sectors keep the FAT behind the boot sector
+  {
+    TEST_ASSERT_TRUE(initWide(512, 17*32768/WIDE_FFSECTOR_SIZE));
+    TEST_ASSERT_TRUE(VIFLASH_ComputeFormat(1, 16, &fmt));
+    TEST_ASSERT_EQUAL_UINT32(1, fmt.reservedSectors);
+    TEST_ASSERT_EQUAL_UINT32(512, fmt.dataStartSector);
+  }
+  // Test 6: a boot sector in a bigger erase sector moves the FAT to a smallest one,
+  // FAT12 up to 4085 clusters like FatFs decides
+  {
+    TEST_ASSERT_TRUE(initWide(0, 520 + 2*4085));
+    TEST_ASSERT_TRUE(VIFLASH_ComputeFormat(1, 16, &fmt));
+    TEST_ASSERT_EQUAL_UINT32(4, fmt.reservedSectors);
+    TEST_ASSERT_EQUAL_UINT32(520, fmt.dataStartSector);
+    TEST_ASSERT_EQUAL_UINT32(2, fmt.clusterSize);
+    TEST_ASSERT_EQUAL_UINT32(4085, fmt.clusterCount);
+    TEST_ASSERT_EQUAL_UINT32(12, fmt.fatType);
+    TEST_ASSERT_TRUE(initWide(0, 520 + 2*4086));
+    TEST_ASSERT_TRUE(VIFLASH_ComputeFormat(1, 16, &fmt));
+    TEST_ASSERT_EQUAL_UINT32(4086, fmt.clusterCount);
+    TEST_ASSERT_EQUAL_UINT32(16, fmt.fatType);
+  }
+}
+
+// ===================================================================================
+// Test VIFLASH_FormatVolume =========================================================
+TEST(TST_VIFLASHDRV_FMT, VIFLASH_FormatVolume)
+{
+  VIFLASH_Format_t fmt;
+  TEST_ASSERT_TRUE(VIFLASH_ComputeFormat(2, 64, &fmt));
+  TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_FormatVolume(&fmt));
+
+  // boot sector
+  TEST_ASSERT_EQUAL_UINT8(0xEB, testFlash[0]);
+  TEST_ASSERT_EQUAL_UINT8(FFSECTOR_SIZE & 0xFF, testFlash[11]);
+  TEST_ASSERT_EQUAL_UINT8(FFSECTOR_SIZE >> 8, testFlash[12]);
+  TEST_ASSERT_EQUAL_UINT8(fmt.clusterSize, testFlash[13]);
+  TEST_ASSERT_EQUAL_UINT8(fmt.reservedSectors, testFlash[14]);
+  TEST_ASSERT_EQUAL_UINT8(2, testFlash[16]);
+  TEST_ASSERT_EQUAL_UINT8(fmt.fatSectors, testFlash[22]);
+  TEST_ASSERT_EQUAL_UINT8(0x55, testFlash[510]);
+  TEST_ASSERT_EQUAL_UINT8(0xAA, testFlash[511]);
+  // both FATs start with media descriptor
+  for(uint32_t i = 0; i < 2; i++) {
+    uint8_t *fat = testFlash + (fmt.reservedSectors + i * fmt.fatSectors) * FFSECTOR_SIZE;
+    TEST_ASSERT_EQUAL_UINT8(0xF8, fat[0]);
+    TEST_ASSERT_EQUAL_UINT8(0xFF, fat[1]);
+    TEST_ASSERT_EQUAL_UINT8(0xFF, fat[2]);
+    TEST_ASSERT_EQUAL_UINT8(0x00, fat[3]);
+  }
+  // data area untouched
+  TEST_ASSERT_EQUAL_UINT8(0xFF, testFlash[fmt.dataStartSector * FFSECTOR_SIZE]);
+  TEST_ASSERT_EQUAL_UINT32(0, calledEraseCounter);
+
+  // reformat erases each metadata sector once
+  TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_FormatVolume(&fmt));
+  TEST_ASSERT_EQUAL_UINT32(0, calledEraseCounter);
+  testFlash[fmt.reservedSectors * FFSECTOR_SIZE + 4] = 0x12;
+  TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_FormatVolume(&fmt));
+  TEST_ASSERT_EQUAL_UINT32(1, calledEraseCounter);
+  TEST_ASSERT_EQUAL_UINT8(0x00, testFlash[fmt.reservedSectors * FFSECTOR_SIZE + 4]);
+}
+
+uint8_t FAKE_Program(__attribute__((unused)) uint32_t TypeProgram, size_t Address, uint64_t Data) {
+  *(uint32_t*)(Address) &= (uint32_t)Data;
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Unlock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Lock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError) {
+  calledEraseCounter++;
+  for(uint32_t i = 0; i < Sector->NbSectors; i++) {
+    uint8_t *sector = (uint8_t*)FAKE_SectorToAddress(Sector->Sector + i);
+    for(uint32_t j = 0; j < sectorSizes[Sector->Sector + i]; j++)
+      sector[j] = 0xFF;
+  }
+  *SectorError = 0xFFFFFFFF;
+  return VIFLASH_RESULT_OK;
+}
+
+size_t FAKE_SectorToAddress(uint8_t Sector) {
+  size_t address = (size_t)testFlash;
+  for(uint8_t i = 0; i < Sector && i < flashSectors; i++)
+    address += sectorSizes[i];
+  return address;
+}
+
+int8_t FAKE_AddressToSector(size_t Address) {
+  size_t offset = Address - (size_t)testFlash;
+  int8_t sector = 0;
+  while(sector < flashSectors - 1 && offset >= sectorSizes[sector]) {
+    offset -= sectorSizes[sector];
+    sector++;
+  }
+  return sector;
+}
+
+int32_t FAKE_SectorSize(uint8_t Sector) {
+  return sectorSizes[Sector];
+}
@@ -0,0 +1,128 @@
+#include "unity.h"
+#include "unity_fixture.h"
+#include "viflashdrv.h"
+#include "viflashdrv_img.h"
+#include "stdio.h"
+#include "string.h"
+
+static uint8_t FAKE_Program(uint32_t TypeProgram, size_t Address, uint64_t Data);
+static uint8_t FAKE_Unlock(void);
+static uint8_t FAKE_Lock(void);
+static uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError);
+static size_t FAKE_SectorToAddress(uint8_t Sector);
+static int8_t FAKE_AddressToSector(size_t Address);
+static int32_t FAKE_SectorSize(uint8_t Sector);
+
+TEST_GROUP(TST_VIFLASHDRV_IMG);
+
+TEST_GROUP_RUNNER(TST_VIFLASHDRV_IMG) {
+  RUN_TEST_CASE(TST_VIFLASHDRV_IMG, VIFLASH_ImgVerify);
+}
+
+#define DISK_SIZE (128)
+#define DISK_SECTOR_SIZE (32)
+#define FFSECTOR_SIZE (16)
+#define CHUNKS (DISK_SIZE/DISK_SECTOR_SIZE)
+
+static uint8_t testDisk[DISK_SIZE] __attribute__((aligned(8)));
+static uint8_t testBuff[DISK_SIZE] __attribute__((aligned(8)));
+static uint8_t manifest[VIFLASH_IMG_MANIFEST_SIZE(CHUNKS)];
+
+TEST_SETUP(TST_VIFLASHDRV_IMG) {
+  for(uint32_t i = 0; i < DISK_SIZE; i++) {
+    testDisk[i] = 0xFF;
+  }
+}
+
+TEST_TEAR_DOWN(TST_VIFLASHDRV_IMG) {
+  VIFLASH_InitDriver(NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, 0, 0, 0);
+}
+
+// ===================================================================================
+// Test VIFLASH_ImgVerify ============================================================
+TEST(TST_VIFLASHDRV_IMG, VIFLASH_ImgVerify)
+{
+  VIFLASH_ImgReport_t report;
+  // Test 1: driver not initialized
+  {
+    TEST_ASSERT_EQUAL_UINT32(0, VIFLASH_ImgChunks());
+    TEST_ASSERT_EQUAL_UINT32(0, VIFLASH_ImgBuildManifest(manifest, sizeof(manifest)));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_NOTRDY == VIFLASH_ImgVerify(manifest, sizeof(manifest), &report));
+  }
+  // Initialize driver
+  {
+    TEST_ASSERT_TRUE(VIFLASH_InitDriver(
+      FAKE_Program, FAKE_Unlock, FAKE_Lock, FAKE_EraseSector,
+      FAKE_SectorToAddress, FAKE_AddressToSector, FAKE_SectorSize,
+      (size_t)testDisk, (size_t)testDisk+DISK_SIZE, FFSECTOR_SIZE));
+    VIFLASH_SetPrintfCb(printf);
+    VIFLASH_SetDebugLvl(VIFLASH_DEBUG_INFO);
+  }
+  // Test 2: one chunk per erase sector, too small buffer
+  {
+    TEST_ASSERT_EQUAL_UINT32(CHUNKS, VIFLASH_ImgChunks());
+    TEST_ASSERT_EQUAL_UINT32(0, VIFLASH_ImgBuildManifest(manifest, sizeof(manifest) - 1));
+    TEST_ASSERT_EQUAL_UINT32(0, VIFLASH_ImgBuildManifest(NULL, sizeof(manifest)));
+  }
+  // Test 3: manifest of the written content verifies
+  {
+    for(uint32_t j = 0; j < DISK_SIZE; j++) {
+      testBuff[j] = j;
+    }
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 0, DISK_SIZE/FFSECTOR_SIZE));
+    TEST_ASSERT_EQUAL_UINT32(sizeof(manifest), VIFLASH_ImgBuildManifest(manifest, sizeof(manifest)));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_ImgVerify(manifest, sizeof(manifest), &report));
+    TEST_ASSERT_EQUAL_UINT32(CHUNKS, report.chunks);
+    TEST_ASSERT_EQUAL_UINT32(0, report.badChunks);
+  }
+  // Test 4: changed flash content is found per chunk
+  {
+    testDisk[DISK_SECTOR_SIZE*2 + 5] ^= 0x01;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_ERROR == VIFLASH_ImgVerify(manifest, sizeof(manifest), &report));
+    TEST_ASSERT_EQUAL_UINT32(1, report.badChunks);
+    TEST_ASSERT_EQUAL_UINT32(DISK_SECTOR_SIZE*2/FFSECTOR_SIZE, report.firstBadSector);
+    testDisk[DISK_SECTOR_SIZE*2 + 5] ^= 0x01;
+  }
+  // Test 5: damaged or truncated manifest
+  {
+    manifest[VIFLASH_IMG_HEADER_SIZE + 8] ^= 0x01;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_ImgVerify(manifest, sizeof(manifest), &report));
+    manifest[VIFLASH_IMG_HEADER_SIZE + 8] ^= 0x01;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_ImgVerify(manifest, sizeof(manifest) - 4, &report));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_ImgVerify(NULL, sizeof(manifest), &report));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_ImgVerify(manifest, sizeof(manifest), NULL));
+  }
+}
+
+uint8_t FAKE_Program(__attribute__((unused)) uint32_t TypeProgram, size_t Address, uint64_t Data) {
+  *(uint32_t*)(Address) = (uint32_t)Data;
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Unlock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Lock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError) {
+  for(size_t i = 0; i < Sector->NbSectors*DISK_SECTOR_SIZE; i++)
+    testDisk[Sector->Sector*DISK_SECTOR_SIZE+i] = 0xFF;
+  *SectorError = 0xFFFFFFFF;
+  return VIFLASH_RESULT_OK;
+}
+
+size_t FAKE_SectorToAddress(uint8_t Sector) {
+  return (size_t)testDisk+Sector*DISK_SECTOR_SIZE;
+}
+
+int8_t FAKE_AddressToSector(size_t Address) {
+  return (Address - (size_t)testDisk)/DISK_SECTOR_SIZE;
+}
+
+int32_t FAKE_SectorSize(__attribute__((unused)) uint8_t Sector) {
+  return DISK_SECTOR_SIZE;
+}
@@ -0,0 +1,230 @@
+#include "unity.h"
+#include "unity_fixture.h"
+#include "viflashdrv.h"
+#include "viflashdrv_kv.h"
+#include "stdio.h"
+#include "string.h"
+
+static uint32_t calledProgramCounter = 0;
+static uint32_t calledEraseCounter = 0;
+static uint8_t FAKE_Program(uint32_t TypeProgram, size_t Address, uint64_t Data);
+static uint8_t FAKE_Unlock(void);
+static uint8_t FAKE_Lock(void);
+static uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError);
+static size_t FAKE_SectorToAddress(uint8_t Sector);
+static int8_t FAKE_AddressToSector(size_t Address);
+static int32_t FAKE_SectorSize(uint8_t Sector);
+
+TEST_GROUP(TST_VIFLASHDRV_KV);
+
+TEST_GROUP_RUNNER(TST_VIFLASHDRV_KV) {
+  RUN_TEST_CASE(TST_VIFLASHDRV_KV, VIFLASH_KvInit);
+  RUN_TEST_CASE(TST_VIFLASHDRV_KV, VIFLASH_KvSet);
+}
+
+// disk on sectors 0..1, key/value store on sectors 2..3
+#define FLASH_SIZE (1024)
+#define FLASH_SECTOR_SIZE (256)
+#define DISK_SIZE (512)
+#define FFSECTOR_SIZE (64)
+
+static uint8_t testFlash[FLASH_SIZE] __attribute__((aligned(4)));
+
+TEST_SETUP(TST_VIFLASHDRV_KV) {
+  calledProgramCounter = 0;
+  calledEraseCounter = 0;
+  for(uint32_t i = 0; i < FLASH_SIZE; i++) {
+    testFlash[i] = 0xFF;
+  }
+  TEST_ASSERT_TRUE(VIFLASH_InitDriver(
+    FAKE_Program, FAKE_Unlock, FAKE_Lock, FAKE_EraseSector,
+    FAKE_SectorToAddress, FAKE_AddressToSector, FAKE_SectorSize,
+    (size_t)testFlash, (size_t)testFlash+DISK_SIZE, FFSECTOR_SIZE));
+  VIFLASH_SetPrintfCb(printf);
+  VIFLASH_SetDebugLvl(VIFLASH_DEBUG_INFO);
+}
+
+TEST_TEAR_DOWN(TST_VIFLASHDRV_KV) {
+  VIFLASH_InitDriver(NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, 0, 0, 0);
+}
+
+// ===================================================================================
+// Test VIFLASH_KvInit ===============================================================
+TEST(TST_VIFLASHDRV_KV, VIFLASH_KvInit)
+{
+  uint32_t value = 0;
+  // Test 1: wrong parameters
+  {
+    TEST_ASSERT_FALSE(VIFLASH_KvInit(2, 1));
+    TEST_ASSERT_FALSE(VIFLASH_KvInit(1, 2));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_NOTRDY == VIFLASH_KvSet(1, &value, 4));
+  }
+  // Test 2: empty store gets a sector header only
+  {
+    TEST_ASSERT_TRUE(VIFLASH_KvInit(2, 2));
+    TEST_ASSERT_EQUAL_UINT32(2, calledProgramCounter);
+    TEST_ASSERT_EQUAL_UINT32(0, calledEraseCounter);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_ERROR == VIFLASH_KvGet(1, &value, 4, NULL));
+  }
+  // Test 3: index is rebuilt from flash, torn records are ignored
+  {
+    value = 0x11223344;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvSet(1, &value, 4));
+    value = 0x55667788;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvSet(2, &value, 4));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvDelete(2));
+    // header and data of key 1 without the checksum
+    uint32_t *tail = (uint32_t*)(testFlash + 2*FLASH_SECTOR_SIZE + 8 + 2*12 + 8);
+    tail[0] = 1 | (4 << 16);
+    tail[1] = 0xDEADBEEF;
+
+    TEST_ASSERT_TRUE(VIFLASH_KvInit(2, 2));
+    VIFLASH_KvStats_t stats;
+    VIFLASH_KvGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.keys);
+    uint16_t read = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvGet(1, &value, 4, &read));
+    TEST_ASSERT_EQUAL_UINT32(0x11223344, value);
+    TEST_ASSERT_EQUAL_UINT32(4, read);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_ERROR == VIFLASH_KvGet(2, &value, 4, NULL));
+    // appending continues behind the torn record
+    TEST_ASSERT_EQUAL_UINT32(8 + 3*12 + 8, stats.usedBytes);
+  }
+  // Test 4: a torn header closes the sector, appending goes on in a blank one
+  {
+    uint32_t *tail = (uint32_t*)(testFlash + 2*FLASH_SECTOR_SIZE + 8 + 3*12 + 8);
+    tail[0] = 0xFF04FF01;
+    TEST_ASSERT_TRUE(VIFLASH_KvInit(2, 2));
+    VIFLASH_KvStats_t stats;
+    VIFLASH_KvGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(FLASH_SECTOR_SIZE, stats.usedBytes);
+    value = 0x99AABBCC;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvSet(3, &value, 4));
+    TEST_ASSERT_EQUAL_UINT32(1, calledEraseCounter);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvGet(1, &value, 4, NULL));
+    TEST_ASSERT_EQUAL_UINT32(0x11223344, value);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvGet(3, &value, 4, NULL));
+    TEST_ASSERT_EQUAL_UINT32(0x99AABBCC, value);
+  }
+  // Test 5: power cut after the spare sector was opened for a compaction,
+  // init finishes the compaction and the store keeps working
+  {
+    uint32_t *spare = (uint32_t*)(testFlash + 2*FLASH_SECTOR_SIZE);
+    spare[1] = 3;
+    spare[0] = 0x3156564B;
+    TEST_ASSERT_TRUE(VIFLASH_KvInit(2, 2));
+    TEST_ASSERT_EQUAL_UINT32(2, calledEraseCounter);
+    for(uint32_t i = 0; i < FLASH_SECTOR_SIZE; i++)
+      TEST_ASSERT_EQUAL_UINT8(0xFF, testFlash[3*FLASH_SECTOR_SIZE + i]);
+    for(uint32_t counter = 0; counter < 100; counter++) {
+      TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvSet(4, &counter, 4));
+    }
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvGet(1, &value, 4, NULL));
+    TEST_ASSERT_EQUAL_UINT32(0x11223344, value);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvGet(3, &value, 4, NULL));
+    TEST_ASSERT_EQUAL_UINT32(0x99AABBCC, value);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvGet(4, &value, 4, NULL));
+    TEST_ASSERT_EQUAL_UINT32(99, value);
+  }
+}
+
+// ===================================================================================
+// Test VIFLASH_KvSet ================================================================
+TEST(TST_VIFLASHDRV_KV, VIFLASH_KvSet)
+{
+  uint32_t counter = 0;
+  uint8_t name[10] = "viflashdrv";
+  uint8_t buff[10];
+  TEST_ASSERT_TRUE(VIFLASH_KvInit(2, 2));
+  calledProgramCounter = 0;
+
+  // Test 1: wrong parameters
+  {
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_KvSet(0xFFFE, &counter, 4));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_KvSet(1, NULL, 4));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_KvSet(1, testFlash, FLASH_SECTOR_SIZE));
+  }
+  // Test 2: update costs word programs only, unchanged value costs nothing
+  {
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvSet(7, name, sizeof(name)));
+    TEST_ASSERT_EQUAL_UINT32(5, calledProgramCounter);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvSet(7, name, sizeof(name)));
+    TEST_ASSERT_EQUAL_UINT32(5, calledProgramCounter);
+    counter = 1;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvSet(1, &counter, 4));
+    TEST_ASSERT_EQUAL_UINT32(8, calledProgramCounter);
+    TEST_ASSERT_EQUAL_UINT32(0, calledEraseCounter);
+  }
+  // Test 3: full sector is compacted by sector swap
+  {
+    for(counter = 2; counter < 100; counter++) {
+      TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvSet(1, &counter, 4));
+    }
+    VIFLASH_KvStats_t stats;
+    VIFLASH_KvGetStats(&stats);
+    TEST_ASSERT_TRUE(0 < stats.compactions);
+    TEST_ASSERT_EQUAL_UINT32(stats.compactions, calledEraseCounter);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.keys);
+
+    uint32_t value = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvGet(1, &value, 4, NULL));
+    TEST_ASSERT_EQUAL_UINT32(99, value);
+    uint16_t read = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvGet(7, buff, sizeof(buff), &read));
+    TEST_ASSERT_EQUAL_UINT32(sizeof(name), read);
+    TEST_ASSERT_EQUAL_MEMORY(name, buff, sizeof(name));
+  }
+  // Test 4: state survives a restart
+  {
+    TEST_ASSERT_TRUE(VIFLASH_KvInit(2, 2));
+    uint32_t value = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvGet(1, &value, 4, NULL));
+    TEST_ASSERT_EQUAL_UINT32(99, value);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvGet(7, buff, sizeof(buff), NULL));
+    TEST_ASSERT_EQUAL_MEMORY(name, buff, sizeof(name));
+  }
+  // Test 5: disk writes are not affected
+  {
+    uint8_t sector[FFSECTOR_SIZE];
+    memset(sector, 0x5A, sizeof(sector));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(sector, DISK_SIZE/FFSECTOR_SIZE - 1, 1));
+    uint32_t value = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_KvGet(1, &value, 4, NULL));
+    TEST_ASSERT_EQUAL_UINT32(99, value);
+  }
+}
+
+uint8_t FAKE_Program(__attribute__((unused)) uint32_t TypeProgram, size_t Address, uint64_t Data) {
+  calledProgramCounter++;
+  *(uint32_t*)(Address) &= (uint32_t)Data;
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Unlock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Lock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError) {
+  calledEraseCounter++;
+  for(size_t i = 0; i < Sector->NbSectors*FLASH_SECTOR_SIZE; i++)
+    testFlash[Sector->Sector*FLASH_SECTOR_SIZE+i] = 0xFF;
+  *SectorError = 0xFFFFFFFF;
+  return VIFLASH_RESULT_OK;
+}
+
+size_t FAKE_SectorToAddress(uint8_t Sector) {
+  return (size_t)testFlash+Sector*FLASH_SECTOR_SIZE;
+}
+
+int8_t FAKE_AddressToSector(size_t Address) {
+  return (Address - (size_t)testFlash)/FLASH_SECTOR_SIZE;
+}
+
+int32_t FAKE_SectorSize(__attribute__((unused)) uint8_t Sector) {
+  return FLASH_SECTOR_SIZE;
+}
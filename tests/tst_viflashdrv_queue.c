@@ -0,0 +1,209 @@
+#include "unity.h"
+#include "unity_fixture.h"
+#include "viflashdrv.h"
+#include "viflashdrv_queue.h"
+#include "stdio.h"
+#include "string.h"
+
+static uint32_t calledEraseCounter = 0;
+static uint32_t calledSignalCounter = 0;
+static uint8_t FAKE_Program(uint32_t TypeProgram, size_t Address, uint64_t Data);
+static uint8_t FAKE_Unlock(void);
+static uint8_t FAKE_Lock(void);
+static uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError);
+static size_t FAKE_SectorToAddress(uint8_t Sector);
+static int8_t FAKE_AddressToSector(size_t Address);
+static int32_t FAKE_SectorSize(uint8_t Sector);
+static void FAKE_SignalWorker(void);
+static void FAKE_SignalDone(VIFLASH_Request_t *req);
+
+TEST_GROUP(TST_VIFLASHDRV_QUEUE);
+
+TEST_GROUP_RUNNER(TST_VIFLASHDRV_QUEUE) {
+  RUN_TEST_CASE(TST_VIFLASHDRV_QUEUE, VIFLASH_Submit);
+  RUN_TEST_CASE(TST_VIFLASHDRV_QUEUE, VIFLASH_QueueProcess);
+}
+
+// 16 FF-sectors, 4 per flash sector
+#define DISK_SIZE (256)
+#define DISK_SECTOR_SIZE (64)
+#define FFSECTOR_SIZE (16)
+#define DONE_LOG (16)
+
+static uint8_t testDisk[DISK_SIZE] __attribute__((aligned(8)));
+static uint8_t writeBuff[4][FFSECTOR_SIZE];
+static uint8_t readBuff[4][FFSECTOR_SIZE];
+static VIFLASH_Request_t requests[8];
+static VIFLASH_Request_t* doneLog[DONE_LOG];
+static uint32_t doneCount = 0;
+
+static const VIFLASH_QueueHooks_t hooks = {NULL, NULL, FAKE_SignalWorker, FAKE_SignalDone};
+
+static void setRequest(VIFLASH_Request_t *req, uint8_t op, uint8_t prio, void *buff, uint32_t sector) {
+  memset(req, 0, sizeof(*req));
+  req->op = op;
+  req->prio = prio;
+  req->buff = buff;
+  req->sector = sector;
+  req->count = 1;
+}
+
+TEST_SETUP(TST_VIFLASHDRV_QUEUE) {
+  calledEraseCounter = 0;
+  calledSignalCounter = 0;
+  doneCount = 0;
+  // programmed content everywhere, so every change needs an erase
+  for(uint32_t i = 0; i < DISK_SIZE; i++) {
+    testDisk[i] = i;
+  }
+  for(uint32_t i = 0; i < 4; i++) {
+    memset(writeBuff[i], 0x10 + i, FFSECTOR_SIZE);
+  }
+  TEST_ASSERT_TRUE(VIFLASH_InitDriver(
+    FAKE_Program, FAKE_Unlock, FAKE_Lock, FAKE_EraseSector,
+    FAKE_SectorToAddress, FAKE_AddressToSector, FAKE_SectorSize,
+    (size_t)testDisk, (size_t)testDisk+DISK_SIZE, FFSECTOR_SIZE));
+  VIFLASH_SetPrintfCb(printf);
+  VIFLASH_SetDebugLvl(VIFLASH_DEBUG_INFO);
+  TEST_ASSERT_TRUE(VIFLASH_QueueInit(&hooks));
+}
+
+TEST_TEAR_DOWN(TST_VIFLASHDRV_QUEUE) {
+  VIFLASH_InitDriver(NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, 0, 0, 0);
+}
+
+// ===================================================================================
+// Test VIFLASH_Submit ===============================================================
+TEST(TST_VIFLASHDRV_QUEUE, VIFLASH_Submit)
+{
+  // Test 1: wrong parameters
+  {
+    VIFLASH_QueueHooks_t halfLock = {FAKE_SignalWorker, NULL, NULL, NULL};
+    TEST_ASSERT_FALSE(VIFLASH_QueueInit(&halfLock));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_Submit(NULL));
+    setRequest(&requests[0], VIFLASH_REQ_WRITE, VIFLASH_PRIO_BULK, writeBuff[0], DISK_SIZE/FFSECTOR_SIZE);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_Submit(&requests[0]));
+    setRequest(&requests[0], VIFLASH_REQ_WRITE, VIFLASH_PRIO_BULK + 1, writeBuff[0], 0);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_Submit(&requests[0]));
+    setRequest(&requests[0], VIFLASH_REQ_WRITE + 1, VIFLASH_PRIO_BULK, writeBuff[0], 0);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_Submit(&requests[0]));
+    TEST_ASSERT_EQUAL_UINT32(0, calledSignalCounter);
+  }
+  // Test 2: request is queued once, worker is signaled
+  {
+    setRequest(&requests[0], VIFLASH_REQ_READ, VIFLASH_PRIO_NORMAL, readBuff[0], 3);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Submit(&requests[0]));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_Submit(&requests[0]));
+    TEST_ASSERT_EQUAL_UINT32(1, calledSignalCounter);
+    TEST_ASSERT_FALSE(VIFLASH_IsDone(&requests[0]));
+    TEST_ASSERT_EQUAL_UINT32(1, VIFLASH_QueueProcess(0));
+    TEST_ASSERT_TRUE(VIFLASH_IsDone(&requests[0]));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == requests[0].result);
+    TEST_ASSERT_EQUAL_MEMORY(testDisk + 3*FFSECTOR_SIZE, readBuff[0], FFSECTOR_SIZE);
+    TEST_ASSERT_EQUAL_UINT32(0, VIFLASH_QueueProcess(0));
+  }
+}
+
+// ===================================================================================
+// Test VIFLASH_QueueProcess =========================================================
+TEST(TST_VIFLASHDRV_QUEUE, VIFLASH_QueueProcess)
+{
+  VIFLASH_QueueStats_t stats;
+  // Test 1: urgent read jumps ahead of bulk writes
+  {
+    setRequest(&requests[0], VIFLASH_REQ_WRITE, VIFLASH_PRIO_BULK, writeBuff[0], 0);
+    setRequest(&requests[1], VIFLASH_REQ_WRITE, VIFLASH_PRIO_BULK, writeBuff[1], 2);
+    setRequest(&requests[2], VIFLASH_REQ_WRITE, VIFLASH_PRIO_BULK, writeBuff[2], 8);
+    setRequest(&requests[3], VIFLASH_REQ_WRITE, VIFLASH_PRIO_BULK, writeBuff[3], 3);
+    setRequest(&requests[4], VIFLASH_REQ_READ, VIFLASH_PRIO_URGENT, readBuff[0], 13);
+    for(uint32_t i = 0; i < 5; i++)
+      TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Submit(&requests[i]));
+    TEST_ASSERT_EQUAL_UINT32(1, VIFLASH_QueueProcess(1));
+    TEST_ASSERT_TRUE(&requests[4] == doneLog[0]);
+    TEST_ASSERT_EQUAL_UINT32(0, calledEraseCounter);
+  }
+  // Test 2: writes on one flash sector share one read-modify-write
+  {
+    TEST_ASSERT_EQUAL_UINT32(4, VIFLASH_QueueProcess(0));
+    TEST_ASSERT_EQUAL_UINT32(2, calledEraseCounter);
+    VIFLASH_QueueGetStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.rmw);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.merged);
+    TEST_ASSERT_EQUAL_MEMORY(writeBuff[0], testDisk, FFSECTOR_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(writeBuff[1], testDisk + 2*FFSECTOR_SIZE, FFSECTOR_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(writeBuff[3], testDisk + 3*FFSECTOR_SIZE, FFSECTOR_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(writeBuff[2], testDisk + 8*FFSECTOR_SIZE, FFSECTOR_SIZE);
+    for(uint32_t i = 0; i < FFSECTOR_SIZE; i++)
+      TEST_ASSERT_EQUAL_UINT8(FFSECTOR_SIZE + i, testDisk[FFSECTOR_SIZE + i]);
+  }
+  // Test 3: urgent read after a bulk write of the same sector sees the new data
+  {
+    doneCount = 0;
+    memset(writeBuff[0], 0x77, FFSECTOR_SIZE);
+    setRequest(&requests[0], VIFLASH_REQ_WRITE, VIFLASH_PRIO_BULK, writeBuff[0], 5);
+    setRequest(&requests[1], VIFLASH_REQ_READ, VIFLASH_PRIO_URGENT, readBuff[1], 5);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Submit(&requests[0]));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Submit(&requests[1]));
+    TEST_ASSERT_EQUAL_UINT32(2, VIFLASH_QueueProcess(0));
+    TEST_ASSERT_TRUE(&requests[0] == doneLog[0]);
+    TEST_ASSERT_EQUAL_MEMORY(writeBuff[0], readBuff[1], FFSECTOR_SIZE);
+  }
+  // Test 4: elevator order behind the last served sector
+  {
+    doneCount = 0;
+    setRequest(&requests[0], VIFLASH_REQ_READ, VIFLASH_PRIO_NORMAL, readBuff[0], 2);
+    setRequest(&requests[1], VIFLASH_REQ_READ, VIFLASH_PRIO_NORMAL, readBuff[1], 12);
+    setRequest(&requests[2], VIFLASH_REQ_READ, VIFLASH_PRIO_NORMAL, readBuff[2], 7);
+    setRequest(&requests[3], VIFLASH_REQ_READ, VIFLASH_PRIO_BULK, readBuff[3], 6);
+    for(uint32_t i = 0; i < 4; i++)
+      TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Submit(&requests[i]));
+    TEST_ASSERT_EQUAL_UINT32(4, VIFLASH_QueueProcess(0));
+    TEST_ASSERT_TRUE(&requests[2] == doneLog[0]);
+    TEST_ASSERT_TRUE(&requests[1] == doneLog[1]);
+    TEST_ASSERT_TRUE(&requests[0] == doneLog[2]);
+    TEST_ASSERT_TRUE(&requests[3] == doneLog[3]);
+  }
+}
+
+void FAKE_SignalWorker(void) {
+  calledSignalCounter++;
+}
+
+void FAKE_SignalDone(VIFLASH_Request_t *req) {
+  if(DONE_LOG > doneCount)
+    doneLog[doneCount++] = req;
+}
+
+uint8_t FAKE_Program(__attribute__((unused)) uint32_t TypeProgram, size_t Address, uint64_t Data) {
+  *(uint32_t*)(Address) &= (uint32_t)Data;
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Unlock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Lock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError) {
+  calledEraseCounter++;
+  for(size_t i = 0; i < Sector->NbSectors*DISK_SECTOR_SIZE; i++)
+    testDisk[Sector->Sector*DISK_SECTOR_SIZE+i] = 0xFF;
+  *SectorError = 0xFFFFFFFF;
+  return VIFLASH_RESULT_OK;
+}
+
+size_t FAKE_SectorToAddress(uint8_t Sector) {
+  return (size_t)testDisk+Sector*DISK_SECTOR_SIZE;
+}
+
+int8_t FAKE_AddressToSector(size_t Address) {
+  return (Address - (size_t)testDisk)/DISK_SECTOR_SIZE;
+}
+
+int32_t FAKE_SectorSize(__attribute__((unused)) uint8_t Sector) {
+  return DISK_SECTOR_SIZE;
+}
@@ -0,0 +1,193 @@
+#include "unity.h"
+#include "unity_fixture.h"
+#include "viflashdrv.h"
+#include "viflashdrv_trace.h"
+#include "viflashdrv_cmp.h"
+#include "stdio.h"
+#include "string.h"
+
+static uint8_t FAKE_Program(uint32_t TypeProgram, size_t Address, uint64_t Data);
+static uint8_t FAKE_Unlock(void);
+static uint8_t FAKE_Lock(void);
+static uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError);
+static size_t FAKE_SectorToAddress(uint8_t Sector);
+static int8_t FAKE_AddressToSector(size_t Address);
+static int32_t FAKE_SectorSize(uint8_t Sector);
+static uint32_t FAKE_GetTick(void);
+static bool FAKE_Sink(const uint8_t *record, uint32_t size);
+
+TEST_GROUP(TST_VIFLASHDRV_TRACE);
+
+TEST_GROUP_RUNNER(TST_VIFLASHDRV_TRACE) {
+  RUN_TEST_CASE(TST_VIFLASHDRV_TRACE, VIFLASH_Trace);
+}
+
+#define DISK_SIZE (128)
+#define DISK_SECTOR_SIZE (32)
+#define FFSECTOR_SIZE (16)
+#define TRACE_RECORDS (8)
+
+static uint8_t testDisk[DISK_SIZE] __attribute__((aligned(8)));
+static uint8_t testBuff[DISK_SIZE] __attribute__((aligned(8)));
+static uint8_t traceBuff[TRACE_RECORDS * VIFLASH_TRACE_RECORD_SIZE];
+static uint32_t traceRecords = 0;
+static uint32_t tick = 0;
+
+TEST_SETUP(TST_VIFLASHDRV_TRACE) {
+  traceRecords = 0;
+  tick = 1000;
+  for(uint32_t i = 0; i < DISK_SIZE; i++) {
+    testDisk[i] = 0xFF;
+  }
+}
+
+TEST_TEAR_DOWN(TST_VIFLASHDRV_TRACE) {
+  VIFLASH_TraceStop();
+  VIFLASH_EnableCompression(0, false);
+  VIFLASH_InitDriver(NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, 0, 0, 0);
+}
+
+// ===================================================================================
+// Test VIFLASH_Trace ================================================================
+TEST(TST_VIFLASHDRV_TRACE, VIFLASH_Trace)
+{
+  VIFLASH_TraceRecord_t record;
+  // Test 1: driver not initialized
+  {
+    TEST_ASSERT_FALSE(VIFLASH_TraceStart(FAKE_Sink, FAKE_GetTick, 1000000, true));
+  }
+  // Initialize driver
+  {
+    TEST_ASSERT_TRUE(VIFLASH_InitDriver(
+      FAKE_Program, FAKE_Unlock, FAKE_Lock, FAKE_EraseSector,
+      FAKE_SectorToAddress, FAKE_AddressToSector, FAKE_SectorSize,
+      (size_t)testDisk, (size_t)testDisk+DISK_SIZE, FFSECTOR_SIZE));
+    VIFLASH_SetPrintfCb(printf);
+    VIFLASH_SetDebugLvl(VIFLASH_DEBUG_INFO);
+  }
+  // Test 2: start record describes the disk
+  {
+    TEST_ASSERT_FALSE(VIFLASH_TraceStart(NULL, FAKE_GetTick, 1000000, true));
+    TEST_ASSERT_TRUE(VIFLASH_TraceStart(FAKE_Sink, FAKE_GetTick, 1000000, true));
+    TEST_ASSERT_EQUAL_UINT32(1, traceRecords);
+    VIFLASH_TraceDecode(traceBuff, &record);
+    TEST_ASSERT_EQUAL_UINT32(VIFLASH_TRACE_START, record.op);
+    TEST_ASSERT_EQUAL_UINT32(FFSECTOR_SIZE, record.sector);
+    TEST_ASSERT_EQUAL_UINT32(DISK_SIZE/FFSECTOR_SIZE, record.count);
+    TEST_ASSERT_EQUAL_UINT32(1000000, record.duration);
+    TEST_ASSERT_EQUAL_UINT32(VIFLASH_TRACE_MAGIC, record.hash);
+  }
+  // Test 3: write, read and ioctl are recorded
+  {
+    for(uint32_t j = 0; j < FFSECTOR_SIZE*2; j++) {
+      testBuff[j] = j;
+    }
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 2, 2));
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Read(testBuff, 1, 1));
+    uint32_t sectorCount = 0;
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Ioctl(VIFLASH_GET_SECTOR_COUNT, &sectorCount));
+    TEST_ASSERT_EQUAL_UINT32(4, traceRecords);
+
+    VIFLASH_TraceDecode(traceBuff + VIFLASH_TRACE_RECORD_SIZE, &record);
+    TEST_ASSERT_EQUAL_UINT32(VIFLASH_TRACE_WRITE, record.op);
+    TEST_ASSERT_EQUAL_UINT32(VIFLASH_RESULT_OK, record.result);
+    TEST_ASSERT_EQUAL_UINT32(2, record.sector);
+    TEST_ASSERT_EQUAL_UINT32(2, record.count);
+    TEST_ASSERT_EQUAL_UINT32(VIFLASH_TRACE_FLAG_HASH, record.flags);
+    for(uint32_t j = 0; j < FFSECTOR_SIZE*2; j++) {
+      testBuff[j] = j;
+    }
+    TEST_ASSERT_EQUAL_UINT32(VIFLASH_TraceHash(testBuff, FFSECTOR_SIZE*2), record.hash);
+    TEST_ASSERT_TRUE(0 < record.duration);
+
+    VIFLASH_TraceDecode(traceBuff + 2*VIFLASH_TRACE_RECORD_SIZE, &record);
+    TEST_ASSERT_EQUAL_UINT32(VIFLASH_TRACE_READ, record.op);
+    TEST_ASSERT_EQUAL_UINT32(1, record.sector);
+    TEST_ASSERT_EQUAL_UINT32(0, record.flags);
+
+    VIFLASH_TraceDecode(traceBuff + 3*VIFLASH_TRACE_RECORD_SIZE, &record);
+    TEST_ASSERT_EQUAL_UINT32(VIFLASH_TRACE_IOCTL, record.op);
+    TEST_ASSERT_EQUAL_UINT32(VIFLASH_GET_SECTOR_COUNT, record.cmd);
+
+    // erased content is marked
+    memset(testBuff, 0xFF, FFSECTOR_SIZE);
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_OK == VIFLASH_Write(testBuff, 5, 1));
+    VIFLASH_TraceDecode(traceBuff + 4*VIFLASH_TRACE_RECORD_SIZE, &record);
+    TEST_ASSERT_EQUAL_UINT32(VIFLASH_TRACE_FLAG_HASH | VIFLASH_TRACE_FLAG_BLANK, record.flags);
+  }
+  // Test 4: rejected call keeps its result, full sink drops records
+  {
+    TEST_ASSERT_TRUE(VIFLASH_RESULT_PARERR == VIFLASH_Write(testBuff, DISK_SIZE/FFSECTOR_SIZE, 1));
+    VIFLASH_TraceDecode(traceBuff + 5*VIFLASH_TRACE_RECORD_SIZE, &record);
+    TEST_ASSERT_EQUAL_UINT32(VIFLASH_RESULT_PARERR, record.result);
+    TEST_ASSERT_EQUAL_UINT32(0, record.flags);
+    for(uint32_t i = 0; i < 5; i++)
+      VIFLASH_Ioctl(VIFLASH_CTRL_SYNC, NULL);
+    TEST_ASSERT_EQUAL_UINT32(TRACE_RECORDS, traceRecords);
+    TEST_ASSERT_EQUAL_UINT32(3, VIFLASH_TraceStop());
+    VIFLASH_Ioctl(VIFLASH_CTRL_SYNC, NULL);
+    TEST_ASSERT_EQUAL_UINT32(TRACE_RECORDS, traceRecords);
+  }
+  // Test 5: start record has the sector count of the compressed disk
+  {
+    for(uint32_t i = 0; i < DISK_SIZE; i++)
+      testDisk[i] = 0xFF;
+    TEST_ASSERT_TRUE(VIFLASH_InitDriver(
+      FAKE_Program, FAKE_Unlock, FAKE_Lock, FAKE_EraseSector,
+      FAKE_SectorToAddress, FAKE_AddressToSector, FAKE_SectorSize,
+      (size_t)testDisk, (size_t)testDisk+DISK_SIZE, 4));
+    TEST_ASSERT_TRUE(VIFLASH_EnableCompression(DISK_SIZE/4, false));
+    traceRecords = 0;
+    TEST_ASSERT_TRUE(VIFLASH_TraceStart(FAKE_Sink, FAKE_GetTick, 1000000, false));
+    VIFLASH_TraceDecode(traceBuff, &record);
+    TEST_ASSERT_EQUAL_UINT32(VIFLASH_TRACE_START, record.op);
+    TEST_ASSERT_EQUAL_UINT32(4, record.sector);
+    TEST_ASSERT_EQUAL_UINT32(2, record.count);
+  }
+}
+
+bool FAKE_Sink(const uint8_t *record, uint32_t size) {
+  TEST_ASSERT_EQUAL_UINT32(VIFLASH_TRACE_RECORD_SIZE, size);
+  if(TRACE_RECORDS <= traceRecords)
+    return false;
+  memcpy(traceBuff + traceRecords * VIFLASH_TRACE_RECORD_SIZE, record, size);
+  traceRecords++;
+  return true;
+}
+
+uint32_t FAKE_GetTick(void) {
+  return tick++;
+}
+
+uint8_t FAKE_Program(__attribute__((unused)) uint32_t TypeProgram, size_t Address, uint64_t Data) {
+  *(uint32_t*)(Address) = (uint32_t)Data;
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Unlock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_Lock(void) {
+  return VIFLASH_RESULT_OK;
+}
+
+uint8_t FAKE_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError) {
+  for(size_t i = 0; i < Sector->NbSectors*DISK_SECTOR_SIZE; i++)
+    testDisk[Sector->Sector*DISK_SECTOR_SIZE+i] = 0xFF;
+  *SectorError = 0xFFFFFFFF;
+  return VIFLASH_RESULT_OK;
+}
+
+size_t FAKE_SectorToAddress(uint8_t Sector) {
+  return (size_t)testDisk+Sector*DISK_SECTOR_SIZE;
+}
+
+int8_t FAKE_AddressToSector(size_t Address) {
+  return (Address - (size_t)testDisk)/DISK_SECTOR_SIZE;
+}
+
+int32_t FAKE_SectorSize(__attribute__((unused)) uint8_t Sector) {
+  return DISK_SECTOR_SIZE;
+}
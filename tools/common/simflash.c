@@ -0,0 +1,169 @@
+#include "simflash.h"
+#include "viflashdrv.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STATUS_OK     0
+#define STATUS_ERROR  1
+
+static uint8_t *flash = NULL;
+static size_t flashSize = 0;
+static uint32_t sectorCount = 0;
+static uint32_t sectorSizes[SIMFLASH_MAX_SECTORS];
+static uint32_t sectorOffsets[SIMFLASH_MAX_SECTORS];
+static bool unlocked = false;
+
+// STM32F4 typical values: word program 16 us, erase 16K 250 ms .. 128K 1 s
+static SIMFLASH_Cost_t cost = {16.0, 143000.0, 6700.0, 0.0};
+static SIMFLASH_Stats_t stats;
+
+static uint8_t SIM_Program(uint32_t TypeProgram, size_t Address, uint64_t Data) {
+  uint32_t size = 1U << TypeProgram;
+  if(!unlocked || Address < (size_t)flash || Address + size > (size_t)flash + flashSize)
+    return STATUS_ERROR;
+  // NOR flash can only clear bits
+  for(uint32_t i = 0; i < size; i++)
+    ((uint8_t*)Address)[i] &= (uint8_t)(Data >> (8 * i));
+  stats.programs++;
+  stats.programBytes += size;
+  stats.timeUs += cost.programUs;
+  return STATUS_OK;
+}
+
+static uint8_t SIM_Unlock(void) {
+  unlocked = true;
+  return STATUS_OK;
+}
+
+static uint8_t SIM_Lock(void) {
+  unlocked = false;
+  return STATUS_OK;
+}
+
+static uint8_t SIM_EraseSector(VIFLASH_EraseInit_t* Sector, uint32_t *SectorError) {
+  if(!unlocked || Sector->Sector + Sector->NbSectors > sectorCount)
+    return STATUS_ERROR;
+  for(uint32_t i = 0; i < Sector->NbSectors; i++) {
+    uint32_t sector = Sector->Sector + i;
+    memset(flash + sectorOffsets[sector], 0xFF, sectorSizes[sector]);
+    stats.erases++;
+    stats.eraseBytes += sectorSizes[sector];
+    stats.timeUs += cost.eraseBaseUs + cost.erasePerKbUs * sectorSizes[sector] / 1024.0;
+  }
+  *SectorError = 0xFFFFFFFFU;
+  return STATUS_OK;
+}
+
+static size_t SIM_SectorToAddress(uint8_t Sector) {
+  if(Sector >= sectorCount)
+    return (size_t)flash + flashSize;
+  return (size_t)flash + sectorOffsets[Sector];
+}
+
+static int8_t SIM_AddressToSector(size_t Address) {
+  size_t offset = Address - (size_t)flash;
+  for(uint32_t i = 0; i < sectorCount; i++) {
+    if(offset < sectorOffsets[i] + sectorSizes[i])
+      return (int8_t)i;
+  }
+  return (int8_t)(sectorCount - 1);
+}
+
+static int32_t SIM_SectorSize(uint8_t Sector) {
+  if(Sector >= sectorCount)
+    return 0;
+  return (int32_t)sectorSizes[Sector];
+}
+
+static void addSectors(uint32_t size, uint32_t count) {
+  for(uint32_t i = 0; i < count && sectorCount < SIMFLASH_MAX_SECTORS; i++) {
+    sectorOffsets[sectorCount] = (uint32_t)flashSize;
+    sectorSizes[sectorCount] = size;
+    flashSize += size;
+    sectorCount++;
+  }
+}
+
+bool SIMFLASH_Create(const char *geometry) {
+  SIMFLASH_Destroy();
+
+  unsigned long size = 0, count = 0;
+  if(0 == strcmp(geometry, "stm32f4")) {
+    for(uint32_t bank = 0; bank < 2; bank++) {
+      addSectors(16 * 1024, 4);
+      addSectors(64 * 1024, 1);
+      addSectors(128 * 1024, 7);
+    }
+  } else if(2 == sscanf(geometry, "uniform:%lu:%lu", &size, &count) &&
+            0 < size && 0 == size % 4 && 0 < count && SIMFLASH_MAX_SECTORS >= count) {
+    addSectors((uint32_t)size, (uint32_t)count);
+  } else {
+    fprintf(stderr, "Unknown flash geometry '%s'\n", geometry);
+    return false;
+  }
+
+  flash = (uint8_t*)malloc(flashSize);
+  if(NULL == flash) {
+    SIMFLASH_Destroy();
+    return false;
+  }
+  memset(flash, 0xFF, flashSize);
+  SIMFLASH_ResetStats();
+  return true;
+}
+
+void SIMFLASH_Destroy(void) {
+  free(flash);
+  flash = NULL;
+  flashSize = 0;
+  sectorCount = 0;
+}
+
+bool SIMFLASH_InitDriver(size_t diskOffset, size_t diskSize, uint32_t ffSectorSize) {
+  if(NULL == flash || diskOffset + diskSize > flashSize)
+    return false;
+  return VIFLASH_InitDriver(SIM_Program, SIM_Unlock, SIM_Lock, SIM_EraseSector,
+    SIM_SectorToAddress, SIM_AddressToSector, SIM_SectorSize,
+    (size_t)flash + diskOffset, (size_t)flash + diskOffset + diskSize, ffSectorSize);
+}
+
+uint8_t* SIMFLASH_Base(void) {
+  return flash;
+}
+
+size_t SIMFLASH_Size(void) {
+  return flashSize;
+}
+
+uint32_t SIMFLASH_SectorCount(void) {
+  return sectorCount;
+}
+
+uint32_t SIMFLASH_SectorSize(uint32_t sector) {
+  return (sector < sectorCount) ? sectorSizes[sector] : 0;
+}
+
+uint32_t SIMFLASH_SectorOffset(uint32_t sector) {
+  return (sector < sectorCount) ? sectorOffsets[sector] : (uint32_t)flashSize;
+}
+
+void SIMFLASH_SetCost(const SIMFLASH_Cost_t *newCost) {
+  cost = *newCost;
+}
+
+const SIMFLASH_Cost_t* SIMFLASH_GetCost(void) {
+  return &cost;
+}
+
+const SIMFLASH_Stats_t* SIMFLASH_GetStats(void) {
+  return &stats;
+}
+
+void SIMFLASH_AddTime(double us) {
+  stats.timeUs += us;
+}
+
+void SIMFLASH_ResetStats(void) {
+  memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,65 @@
+#ifndef SIMFLASH_H
+#define SIMFLASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SIMFLASH_MAX_SECTORS 128
+
+// Latency model of the simulated flash [us]
+typedef struct {
+  double programUs;     /* per programmed word */
+  double eraseBaseUs;   /* fixed part of a sector erase */
+  double erasePerKbUs;  /* size dependent part of a sector erase */
+  double readPerKbUs;   /* read through the memory bus */
+} SIMFLASH_Cost_t;
+
+typedef struct {
+  uint64_t programs;      /* programmed words */
+  uint64_t programBytes;
+  uint64_t erases;
+  uint64_t eraseBytes;
+  double   timeUs;        /* modelled time of the operations above */
+} SIMFLASH_Stats_t;
+
+/*!
+Create the simulated flash
+\param[in] geometry - "stm32f4" (2 MB, 2 banks of 4x16K, 64K, 7x128K) or
+                      "uniform:<sector size>:<sector count>"
+*/
+bool SIMFLASH_Create(const char *geometry);
+void SIMFLASH_Destroy(void);
+
+/*!
+Initialize the flash driver on a window of the simulated flash
+\param[in] diskOffset - start of the disk window in the flash [B]
+\param[in] diskSize - size of the disk window [B]
+\param[in] ffSectorSize - FF-sector size [B]
+*/
+bool SIMFLASH_InitDriver(size_t diskOffset, size_t diskSize, uint32_t ffSectorSize);
+
+uint8_t* SIMFLASH_Base(void);
+size_t SIMFLASH_Size(void);
+uint32_t SIMFLASH_SectorCount(void);
+uint32_t SIMFLASH_SectorSize(uint32_t sector);
+uint32_t SIMFLASH_SectorOffset(uint32_t sector);
+
+void SIMFLASH_SetCost(const SIMFLASH_Cost_t *cost);
+const SIMFLASH_Cost_t* SIMFLASH_GetCost(void);
+const SIMFLASH_Stats_t* SIMFLASH_GetStats(void);
+void SIMFLASH_ResetStats(void);
+/*!
+Account time of operations which bypass the flash callbacks
+*/
+void SIMFLASH_AddTime(double us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SIMFLASH_H
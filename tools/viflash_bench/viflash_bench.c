@@ -0,0 +1,123 @@
+// Read throughput of VIFLASH_Read on a simulated flash, for aligned and unaligned
+// destination buffers, next to a plain memcpy of the same size.
+#include "viflashdrv.h"
+#include "simflash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void usage(const char *name) {
+  fprintf(stderr,
+    "Usage: %s [options]\n"
+    "  -g <geometry>   stm32f4 or uniform:<sector size>:<sector count> (default uniform:131072:8)\n"
+    "  -f <size>       FF-sector size [B] (default 512)\n"
+    "  -m <MB>         data read per case (default 256)\n", name);
+}
+
+static double now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// MB/s of reading the disk in chunks of count sectors into buff
+static double benchRead(uint8_t *buff, uint32_t diskSectors, uint32_t count, uint64_t total,
+  uint32_t ffSectorSize, uint8_t *check) {
+  uint64_t size = (uint64_t)count * ffSectorSize;
+  uint32_t sector = 0;
+  double start = now();
+  for(uint64_t done = 0; done < total; done += size) {
+    if(VIFLASH_RESULT_OK != VIFLASH_Read(buff, sector, count))
+      return 0.0;
+    *check ^= buff[size - 1];
+    sector += count;
+    if(diskSectors < sector + count)
+      sector = 0;
+  }
+  return total / (now() - start) / 1e6;
+}
+
+static double benchMemcpy(uint8_t *buff, const uint8_t *disk, uint32_t diskSectors, uint32_t count,
+  uint64_t total, uint32_t ffSectorSize, uint8_t *check) {
+  uint64_t size = (uint64_t)count * ffSectorSize;
+  uint32_t sector = 0;
+  double start = now();
+  for(uint64_t done = 0; done < total; done += size) {
+    memcpy(buff, disk + (size_t)sector * ffSectorSize, size);
+    *check ^= buff[size - 1];
+    sector += count;
+    if(diskSectors < sector + count)
+      sector = 0;
+  }
+  return total / (now() - start) / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+  const char *geometry = "uniform:131072:8";
+  uint32_t ffSectorSize = 512;
+  uint64_t total = 256;
+  static const uint32_t counts[] = {1, 8, 64};
+  static const uint32_t offsets[] = {0, 1, 3, 8};
+
+  for(int i = 1; i < argc; i++) {
+    if('-' == argv[i][0] && '\0' != argv[i][1] && i + 1 < argc) {
+      const char *value = argv[++i];
+      switch(argv[i - 1][1]) {
+        case 'g': geometry = value; break;
+        case 'f': ffSectorSize = strtoul(value, NULL, 0); break;
+        case 'm': total = strtoull(value, NULL, 0); break;
+        default: usage(argv[0]); return 1;
+      }
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  total *= 1000000;
+  if(0 == ffSectorSize || 0 != ffSectorSize % 4) {
+    fprintf(stderr, "FF-sector size %u must be a nonzero multiple of 4\n", ffSectorSize);
+    return 1;
+  }
+
+  if(!SIMFLASH_Create(geometry))
+    return 1;
+  size_t diskSize = SIMFLASH_Size() - SIMFLASH_Size() % ffSectorSize;
+  uint32_t diskSectors = diskSize / ffSectorSize;
+  if(diskSectors < counts[2] || !SIMFLASH_InitDriver(0, diskSize, ffSectorSize)) {
+    fprintf(stderr, "FF-sector size %u does not fit the flash\n", ffSectorSize);
+    SIMFLASH_Destroy();
+    return 1;
+  }
+  VIFLASH_SetDebugLvl(VIFLASH_DEBUG_DISABLED);
+  for(size_t i = 0; i < diskSize; i++)
+    SIMFLASH_Base()[i] = (uint8_t)(i * 31 + 7);
+
+  uint8_t *buff = (uint8_t*)malloc((size_t)counts[2] * ffSectorSize + 64);
+  if(NULL == buff) {
+    fprintf(stderr, "Out of memory\n");
+    SIMFLASH_Destroy();
+    return 1;
+  }
+  // start at a 64 byte boundary, the offsets below are relative to it
+  uint8_t *aligned = buff + ((64 - ((uintptr_t)buff & 63)) & 63);
+
+  printf("Disk: %u FF-sectors x %u B, geometry %s, %llu MB per case\n\n",
+    diskSectors, ffSectorSize, geometry, (unsigned long long)(total / 1000000));
+  printf("%-8s %-8s %14s %14s\n", "sectors", "offset", "VIFLASH_Read", "memcpy");
+  uint8_t check = 0;
+  for(size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    for(size_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+      uint8_t *dst = aligned + offsets[o];
+      double readMbs = benchRead(dst, diskSectors, counts[c], total, ffSectorSize, &check);
+      double copyMbs = benchMemcpy(dst, SIMFLASH_Base(), diskSectors, counts[c], total,
+        ffSectorSize, &check);
+      printf("%-8u %-8u %9.0f MB/s %9.0f MB/s\n", counts[c], offsets[o], readMbs, copyMbs);
+    }
+  }
+  printf("\n(check %02X)\n", check);
+
+  free(buff);
+  SIMFLASH_Destroy();
+  return 0;
+}
@@ -0,0 +1,347 @@
+// Host side disk image builder: lays out a FAT12/16 volume with the format rules
+// of the driver (viflashdrv_fmt.h), copies a directory tree into it and writes the
+// disk window as a flat image plus a CRC manifest for VIFLASH_ImgVerify.
+#include "viflashdrv.h"
+#include "viflashdrv_fmt.h"
+#include "viflashdrv_img.h"
+#include "simflash.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define DIR_ENTRY_SIZE  32
+#define ATTR_DIRECTORY  0x10
+#define ATTR_ARCHIVE    0x20
+
+typedef struct {
+  VIFLASH_Format_t fmt;
+  uint8_t *disk;            /* disk window in the simulated flash */
+  uint32_t clusterBytes;
+  uint32_t nextCluster;     /* next free cluster, clusters are allocated in a row */
+  uint32_t files;
+  uint32_t dirs;
+  uint64_t bytes;
+  bool verbose;
+} Image_t;
+
+static Image_t img;
+
+static void usage(const char *name) {
+  fprintf(stderr,
+    "Usage: %s [options] <directory> <image>\n"
+    "  -g <geometry>   stm32f4 (default) or uniform:<sector size>:<sector count>\n"
+    "  -o <offset>     start of the disk window in the flash [B] (default 0)\n"
+    "  -s <size>       size of the disk window [B] (default: up to the end of the flash)\n"
+    "  -f <size>       FF-sector size [B] (default 512)\n"
+    "  -n <count>      FAT copies (default 1)\n"
+    "  -r <count>      root directory entries (default 128)\n"
+    "  -m <manifest>   write the CRC manifest for VIFLASH_ImgVerify\n"
+    "  -v              list the copied files with their CRC32\n", name);
+}
+
+static uint8_t* sectorPtr(uint32_t ffSector) {
+  return img.disk + (size_t)ffSector * img.fmt.bytesPerSector;
+}
+
+static uint8_t* clusterPtr(uint32_t cluster) {
+  return sectorPtr(img.fmt.dataStartSector + (cluster - 2) * img.fmt.clusterSize);
+}
+
+static void putWord(uint8_t *buff, uint16_t value) {
+  buff[0] = (uint8_t)value;
+  buff[1] = (uint8_t)(value >> 8);
+}
+
+static void putDword(uint8_t *buff, uint32_t value) {
+  putWord(buff, (uint16_t)value);
+  putWord(buff + 2, (uint16_t)(value >> 16));
+}
+
+static void setFat(uint32_t cluster, uint32_t value) {
+  for(uint32_t copy = 0; copy < img.fmt.numFats; copy++) {
+    uint8_t *fat = sectorPtr(img.fmt.reservedSectors + copy * img.fmt.fatSectors);
+    if(16 == img.fmt.fatType) {
+      putWord(fat + cluster * 2, (uint16_t)value);
+      continue;
+    }
+    uint32_t offset = cluster + cluster / 2;
+    if(cluster & 1) {
+      fat[offset] = (fat[offset] & 0x0F) | (uint8_t)((value << 4) & 0xF0);
+      fat[offset + 1] = (uint8_t)(value >> 4);
+    } else {
+      fat[offset] = (uint8_t)value;
+      fat[offset + 1] = (fat[offset + 1] & 0xF0) | (uint8_t)((value >> 8) & 0x0F);
+    }
+  }
+}
+
+// chain of clusters in a row, first is 0 for an empty chain
+static bool allocChain(uint64_t bytes, uint32_t *first) {
+  uint64_t clusters = (bytes + img.clusterBytes - 1) / img.clusterBytes;
+  *first = 0;
+  if(0 == clusters)
+    return true;
+  if(img.nextCluster + clusters > img.fmt.clusterCount + 2) {
+    fprintf(stderr, "Volume is full\n");
+    return false;
+  }
+  *first = img.nextCluster;
+  uint32_t endOfChain = (16 == img.fmt.fatType) ? 0xFFFF : 0xFFF;
+  for(uint32_t i = 0; i < clusters; i++)
+    setFat(*first + i, (i + 1 < clusters) ? *first + i + 1 : endOfChain);
+  img.nextCluster += (uint32_t)clusters;
+  return true;
+}
+
+// 8.3 name, long file names are not generated
+static bool shortName(const char *name, uint8_t *out) {
+  const char *dot = strrchr(name, '.');
+  size_t baseLen = (NULL != dot) ? (size_t)(dot - name) : strlen(name);
+  size_t extLen = (NULL != dot) ? strlen(dot + 1) : 0;
+  if(0 == baseLen || 8 < baseLen || 3 < extLen)
+    return false;
+  memset(out, ' ', 11);
+  for(size_t i = 0; i < baseLen + extLen; i++) {
+    unsigned char c = (unsigned char)((i < baseLen) ? name[i] : dot[1 + i - baseLen]);
+    if(!isalnum(c) && NULL == strchr("$%'-_@~`!(){}^#&", c))
+      return false;
+    out[(i < baseLen) ? i : 8 + i - baseLen] = (uint8_t)toupper(c);
+  }
+  if(0xE5 == out[0])
+    out[0] = 0x05;
+  return true;
+}
+
+static void putEntry(uint8_t *entry, const uint8_t *name, uint8_t attr, uint32_t cluster,
+  uint32_t size, time_t mtime) {
+  struct tm *tm = localtime(&mtime);
+  uint16_t date = 0x21;  /* 1980-01-01 */
+  uint16_t dosTime = 0;
+  if(NULL != tm && 80 <= tm->tm_year) {
+    date = (uint16_t)(((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) | tm->tm_mday);
+    dosTime = (uint16_t)((tm->tm_hour << 11) | (tm->tm_min << 5) | (tm->tm_sec / 2));
+  }
+  memset(entry, 0, DIR_ENTRY_SIZE);
+  memcpy(entry, name, 11);
+  entry[11] = attr;
+  putWord(entry + 14, dosTime);
+  putWord(entry + 16, date);
+  putWord(entry + 18, date);
+  putWord(entry + 22, dosTime);
+  putWord(entry + 24, date);
+  putWord(entry + 26, (uint16_t)cluster);
+  putDword(entry + 28, size);
+}
+
+static int notDots(const struct dirent *entry) {
+  return 0 != strcmp(entry->d_name, ".") && 0 != strcmp(entry->d_name, "..");
+}
+
+static bool addFile(const char *path, const uint8_t *name, const struct stat *st, uint8_t *entry) {
+  if(0xFFFFFFFFULL < (uint64_t)st->st_size) {
+    fprintf(stderr, "'%s' is too big for FAT\n", path);
+    return false;
+  }
+  uint32_t first = 0;
+  if(!allocChain((uint64_t)st->st_size, &first))
+    return false;
+  if(0 != first) {
+    FILE *file = fopen(path, "rb");
+    if(NULL == file || (size_t)st->st_size != fread(clusterPtr(first), 1, st->st_size, file)) {
+      fprintf(stderr, "Cannot read '%s'\n", path);
+      if(NULL != file)
+        fclose(file);
+      return false;
+    }
+    fclose(file);
+  }
+  putEntry(entry, name, ATTR_ARCHIVE, first, (uint32_t)st->st_size, st->st_mtime);
+  if(img.verbose) {
+    uint32_t crc = (0 != first) ? VIFLASH_Crc32(0, clusterPtr(first), (uint32_t)st->st_size) : 0;
+    printf("  %08X %10lld  %s\n", crc, (long long)st->st_size, path);
+  }
+  img.files++;
+  img.bytes += st->st_size;
+  return true;
+}
+
+// fill the entries of a directory, used entries ('.', '..') are kept
+static bool addDir(const char *path, uint8_t *entries, uint32_t maxEntries, uint32_t used,
+  uint32_t self) {
+  struct dirent **list = NULL;
+  int count = scandir(path, &list, notDots, alphasort);
+  if(0 > count) {
+    fprintf(stderr, "Cannot read directory '%s'\n", path);
+    return false;
+  }
+
+  bool success = true;
+  for(int i = 0; i < count && success; i++) {
+    char childPath[4096];
+    uint8_t name[11];
+    struct stat st;
+    snprintf(childPath, sizeof(childPath), "%s/%s", path, list[i]->d_name);
+    if(0 != stat(childPath, &st)) {
+      fprintf(stderr, "Cannot stat '%s'\n", childPath);
+      success = false;
+      break;
+    }
+    if(!shortName(list[i]->d_name, name)) {
+      fprintf(stderr, "'%s' is not an 8.3 name\n", childPath);
+      success = false;
+      break;
+    }
+    for(uint32_t j = 0; j < used && success; j++) {
+      if(0 == memcmp(entries + j * DIR_ENTRY_SIZE, name, 11)) {
+        fprintf(stderr, "'%s' clashes with another name in 8.3 form\n", childPath);
+        success = false;
+      }
+    }
+    if(!success)
+      break;
+    if(used >= maxEntries) {
+      fprintf(stderr, "Too many entries in '%s'\n", path);
+      success = false;
+      break;
+    }
+
+    uint8_t *entry = entries + used * DIR_ENTRY_SIZE;
+    if(S_ISDIR(st.st_mode)) {
+      struct dirent **children = NULL;
+      int childCount = scandir(childPath, &children, notDots, alphasort);
+      for(int j = 0; j < childCount; j++)
+        free(children[j]);
+      free(children);
+      uint32_t first = 0;
+      uint32_t entryCount = 2 + (uint32_t)((0 < childCount) ? childCount : 0);
+      success = allocChain((uint64_t)entryCount * DIR_ENTRY_SIZE, &first);
+      if(!success)
+        break;
+      uint32_t clusters = (entryCount * DIR_ENTRY_SIZE + img.clusterBytes - 1) / img.clusterBytes;
+      uint8_t *dir = clusterPtr(first);
+      memset(dir, 0, (size_t)clusters * img.clusterBytes);
+      putEntry(dir, (const uint8_t*)".          ", ATTR_DIRECTORY, first, 0, st.st_mtime);
+      putEntry(dir + DIR_ENTRY_SIZE, (const uint8_t*)"..         ", ATTR_DIRECTORY, self, 0, st.st_mtime);
+      putEntry(entry, name, ATTR_DIRECTORY, first, 0, st.st_mtime);
+      img.dirs++;
+      success = addDir(childPath, dir, clusters * img.clusterBytes / DIR_ENTRY_SIZE, 2, first);
+    } else if(S_ISREG(st.st_mode)) {
+      success = addFile(childPath, name, &st, entry);
+    } else {
+      fprintf(stderr, "Skipping '%s'\n", childPath);
+      continue;
+    }
+    used++;
+  }
+
+  for(int i = 0; i < count; i++)
+    free(list[i]);
+  free(list);
+  return success;
+}
+
+static bool writeFile(const char *path, const uint8_t *data, size_t size) {
+  FILE *file = fopen(path, "wb");
+  if(NULL == file || size != fwrite(data, 1, size, file)) {
+    fprintf(stderr, "Cannot write '%s'\n", path);
+    if(NULL != file)
+      fclose(file);
+    return false;
+  }
+  return 0 == fclose(file);
+}
+
+int main(int argc, char *argv[]) {
+  const char *geometry = "stm32f4";
+  const char *manifestPath = NULL;
+  const char *sourcePath = NULL;
+  const char *imagePath = NULL;
+  size_t diskOffset = 0;
+  size_t diskSize = 0;
+  uint32_t ffSectorSize = 512;
+  uint8_t numFats = 1;
+  uint16_t rootEntries = 128;
+
+  for(int i = 1; i < argc; i++) {
+    if(0 == strcmp(argv[i], "-v")) {
+      img.verbose = true;
+    } else if('-' == argv[i][0] && '\0' != argv[i][1] && i + 1 < argc) {
+      const char *value = argv[++i];
+      switch(argv[i - 1][1]) {
+        case 'g': geometry = value; break;
+        case 'o': diskOffset = strtoul(value, NULL, 0); break;
+        case 's': diskSize = strtoul(value, NULL, 0); break;
+        case 'f': ffSectorSize = strtoul(value, NULL, 0); break;
+        case 'n': numFats = (uint8_t)strtoul(value, NULL, 0); break;
+        case 'r': rootEntries = (uint16_t)strtoul(value, NULL, 0); break;
+        case 'm': manifestPath = value; break;
+        default: usage(argv[0]); return 1;
+      }
+    } else if(NULL == sourcePath && '-' != argv[i][0]) {
+      sourcePath = argv[i];
+    } else if(NULL == imagePath && '-' != argv[i][0]) {
+      imagePath = argv[i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if(NULL == sourcePath || NULL == imagePath) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if(!SIMFLASH_Create(geometry))
+    return 1;
+  if(0 == diskSize && diskOffset < SIMFLASH_Size())
+    diskSize = SIMFLASH_Size() - diskOffset;
+  if(!SIMFLASH_InitDriver(diskOffset, diskSize, ffSectorSize)) {
+    fprintf(stderr, "Disk window of %zu B at offset %zu does not fit the flash\n", diskSize, diskOffset);
+    SIMFLASH_Destroy();
+    return 1;
+  }
+  VIFLASH_SetDebugLvl(VIFLASH_DEBUG_DISABLED);
+
+  // same layout as VIFLASH_ComputeFormat/VIFLASH_FormatVolume give on the target
+  if(!VIFLASH_ComputeFormat(numFats, rootEntries, &img.fmt) ||
+     VIFLASH_RESULT_OK != VIFLASH_FormatVolume(&img.fmt)) {
+    fprintf(stderr, "No FAT12/16 layout fits the disk window\n");
+    SIMFLASH_Destroy();
+    return 1;
+  }
+  img.disk = SIMFLASH_Base() + diskOffset;
+  img.clusterBytes = img.fmt.clusterSize * img.fmt.bytesPerSector;
+  img.nextCluster = 2;
+
+  printf("Disk: %u FF-sectors x %u B at offset 0x%zX, geometry %s\n",
+    img.fmt.totalSectors, img.fmt.bytesPerSector, diskOffset, geometry);
+  printf("Layout: FAT%u, %u B clusters, FAT at %u, data at %u, %u clusters\n",
+    img.fmt.fatType, img.clusterBytes, img.fmt.reservedSectors, img.fmt.dataStartSector,
+    img.fmt.clusterCount);
+
+  uint8_t *root = sectorPtr(img.fmt.reservedSectors + img.fmt.numFats * img.fmt.fatSectors);
+  bool success = addDir(sourcePath, root, img.fmt.rootEntries, 0, 0) &&
+    writeFile(imagePath, img.disk, diskSize);
+
+  if(success && NULL != manifestPath) {
+    uint32_t manifestSize = VIFLASH_IMG_MANIFEST_SIZE(VIFLASH_ImgChunks());
+    uint8_t *manifest = (uint8_t*)malloc(manifestSize);
+    success = (NULL != manifest) &&
+      (manifestSize == VIFLASH_ImgBuildManifest(manifest, manifestSize)) &&
+      writeFile(manifestPath, manifest, manifestSize);
+    if(success)
+      printf("Manifest: %u chunks, %u B\n", VIFLASH_ImgChunks(), manifestSize);
+    free(manifest);
+  }
+  if(success) {
+    printf("Content: %u files, %u directories, %llu B in %u clusters\n",
+      img.files, img.dirs, (unsigned long long)img.bytes, img.nextCluster - 2);
+  }
+
+  SIMFLASH_Destroy();
+  return success ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+// Replay of a captured I/O trace (see viflashdrv_trace.h) against a simulated
+// flash. Reports erases, programs, bytes moved and modelled latency.
+#include "viflashdrv.h"
+#include "viflashdrv_trace.h"
+#include "simflash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  uint64_t calls;
+  uint64_t sectors;
+  double timeUs;
+  double maxUs;
+  double fieldUs;
+} OpStats_t;
+
+static const char *opNames[] = {"start", "write", "read", "ioctl"};
+
+static void usage(const char *name) {
+  fprintf(stderr,
+    "Usage: %s [options] <trace file>\n"
+    "  -g <geometry>   stm32f4 (default) or uniform:<sector size>:<sector count>\n"
+    "  -o <offset>     start of the disk window in the flash [B] (default 0)\n"
+    "  -i <image>      initial flash content (default: erased)\n"
+    "  -p <us>         word program time (default 16)\n"
+    "  -e <us>         sector erase base time (default 143000)\n"
+    "  -k <us>         sector erase time per KB (default 6700)\n"
+    "  -r <us>         read time per KB (default 0)\n"
+    "  -v              print every replayed record\n", name);
+}
+
+// Same hash gives same content, so unchanged rewrites stay unchanged
+static void fillData(uint8_t *buff, uint32_t size, uint32_t seed) {
+  uint32_t state = (0 != seed) ? seed : 0x9E3779B9U;
+  for(uint32_t i = 0; i < size; i++) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    buff[i] = (uint8_t)state;
+  }
+}
+
+// Bytes the driver copies into its sector buffer for a write
+static uint64_t mergeBytes(size_t diskOffset, uint32_t ffSectorSize, uint32_t sector, uint32_t count) {
+  size_t start = diskOffset + (size_t)sector * ffSectorSize;
+  size_t stop = start + (size_t)count * ffSectorSize;
+  uint64_t bytes = 0;
+  for(uint32_t i = 0; i < SIMFLASH_SectorCount(); i++) {
+    size_t sectorStart = SIMFLASH_SectorOffset(i);
+    size_t sectorStop = sectorStart + SIMFLASH_SectorSize(i);
+    if(sectorStart < stop && sectorStop > start)
+      bytes += SIMFLASH_SectorSize(i);
+  }
+  return bytes;
+}
+
+static bool loadImage(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if(NULL == file) {
+    fprintf(stderr, "Cannot open image '%s'\n", path);
+    return false;
+  }
+  size_t size = fread(SIMFLASH_Base(), 1, SIMFLASH_Size(), file);
+  fclose(file);
+  printf("Loaded %zu bytes of initial flash content\n", size);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  const char *geometry = "stm32f4";
+  const char *image = NULL;
+  const char *tracePath = NULL;
+  size_t diskOffset = 0;
+  bool verbose = false;
+  SIMFLASH_Cost_t cost = {16.0, 143000.0, 6700.0, 0.0};
+
+  for(int i = 1; i < argc; i++) {
+    if(0 == strcmp(argv[i], "-v")) {
+      verbose = true;
+    } else if('-' == argv[i][0] && '\0' != argv[i][1] && i + 1 < argc) {
+      const char *value = argv[++i];
+      switch(argv[i - 1][1]) {
+        case 'g': geometry = value; break;
+        case 'o': diskOffset = strtoul(value, NULL, 0); break;
+        case 'i': image = value; break;
+        case 'p': cost.programUs = atof(value); break;
+        case 'e': cost.eraseBaseUs = atof(value); break;
+        case 'k': cost.erasePerKbUs = atof(value); break;
+        case 'r': cost.readPerKbUs = atof(value); break;
+        default: usage(argv[0]); return 1;
+      }
+    } else if(NULL == tracePath && '-' != argv[i][0]) {
+      tracePath = argv[i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if(NULL == tracePath) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  FILE *trace = fopen(tracePath, "rb");
+  if(NULL == trace) {
+    fprintf(stderr, "Cannot open trace '%s'\n", tracePath);
+    return 1;
+  }
+
+  // everything behind this point leaves through done
+  int exitCode = 1;
+  bool simflash = false;
+  uint8_t *buff = NULL;
+  uint32_t buffSize = 0;
+  uint8_t raw[VIFLASH_TRACE_RECORD_SIZE];
+  VIFLASH_TraceRecord_t record;
+  if(1 != fread(raw, VIFLASH_TRACE_RECORD_SIZE, 1, trace)) {
+    fprintf(stderr, "Empty trace\n");
+    goto done;
+  }
+  VIFLASH_TraceDecode(raw, &record);
+  if(VIFLASH_TRACE_START != record.op || VIFLASH_TRACE_MAGIC != record.hash) {
+    fprintf(stderr, "Trace does not begin with a start record\n");
+    goto done;
+  }
+  uint32_t ffSectorSize = record.sector;
+  uint32_t diskSectors = record.count;
+  uint32_t tickHz = record.duration;
+  bool hashed = 0 != (record.flags & VIFLASH_TRACE_FLAG_HASH);
+
+  if(!SIMFLASH_Create(geometry))
+    goto done;
+  simflash = true;
+  SIMFLASH_SetCost(&cost);
+  if((NULL != image && !loadImage(image)) ||
+     !SIMFLASH_InitDriver(diskOffset, (size_t)diskSectors * ffSectorSize, ffSectorSize)) {
+    fprintf(stderr, "Disk of %u x %u B does not fit the flash at offset %zu\n",
+      diskSectors, ffSectorSize, diskOffset);
+    goto done;
+  }
+  VIFLASH_SetDebugLvl(VIFLASH_DEBUG_DISABLED);
+
+  printf("Disk: %u FF-sectors x %u B at offset 0x%zX, geometry %s\n",
+    diskSectors, ffSectorSize, diskOffset, geometry);
+
+  OpStats_t ops[4];
+  memset(ops, 0, sizeof(ops));
+  uint64_t movedBytes = 0, failed = 0, records = 0;
+
+  while(1 == fread(raw, VIFLASH_TRACE_RECORD_SIZE, 1, trace)) {
+    VIFLASH_TraceDecode(raw, &record);
+    records++;
+    if(VIFLASH_TRACE_IOCTL < record.op || VIFLASH_TRACE_START == record.op)
+      continue;
+    // calls the driver rejected in the field are not replayed
+    if(VIFLASH_RESULT_OK != record.result)
+      continue;
+
+    // ioctl answers go to the buffer too, one uint32_t at least
+    uint32_t size = record.count * ffSectorSize;
+    uint32_t need = (sizeof(uint32_t) > size) ? sizeof(uint32_t) : size;
+    if(need > buffSize) {
+      free(buff);
+      buffSize = need;
+      buff = (uint8_t*)malloc(buffSize);
+      if(NULL == buff) {
+        fprintf(stderr, "Out of memory\n");
+        goto done;
+      }
+    }
+
+    double before = SIMFLASH_GetStats()->timeUs;
+    VIFLASH_Result_t res = VIFLASH_RESULT_OK;
+    switch(record.op) {
+      case VIFLASH_TRACE_WRITE: {
+        if(record.flags & VIFLASH_TRACE_FLAG_BLANK)
+          memset(buff, 0xFF, size);
+        else
+          fillData(buff, size, (record.flags & VIFLASH_TRACE_FLAG_HASH) ?
+            record.hash : (uint32_t)records);
+        res = VIFLASH_Write(buff, record.sector, record.count);
+        movedBytes += mergeBytes(diskOffset, ffSectorSize, record.sector, record.count);
+        break;
+      }
+      case VIFLASH_TRACE_READ: {
+        res = VIFLASH_Read(buff, record.sector, record.count);
+        movedBytes += size;
+        // reads go through the memory bus, not the flash callbacks
+        SIMFLASH_AddTime(cost.readPerKbUs * size / 1024.0);
+        break;
+      }
+      case VIFLASH_TRACE_IOCTL: {
+        res = VIFLASH_Ioctl(record.cmd, buff);
+        break;
+      }
+    }
+    double spent = SIMFLASH_GetStats()->timeUs - before;
+
+    OpStats_t *op = &ops[record.op];
+    op->calls++;
+    op->sectors += record.count;
+    op->timeUs += spent;
+    if(spent > op->maxUs)
+      op->maxUs = spent;
+    if(0 != tickHz)
+      op->fieldUs += record.duration * 1e6 / tickHz;
+    if(VIFLASH_RESULT_OK != res)
+      failed++;
+    if(verbose)
+      printf("%-5s sector %6u count %4u -> %d, %.0f us\n",
+        opNames[record.op], record.sector, record.count, res, spent);
+  }
+
+  const SIMFLASH_Stats_t *stats = SIMFLASH_GetStats();
+  movedBytes += stats->programBytes;
+  printf("\nRecords:        %llu (%llu failed on replay)\n",
+    (unsigned long long)records, (unsigned long long)failed);
+  printf("Erases:         %llu (%llu KB)\n",
+    (unsigned long long)stats->erases, (unsigned long long)(stats->eraseBytes / 1024));
+  printf("Programs:       %llu words (%llu B)\n",
+    (unsigned long long)stats->programs, (unsigned long long)stats->programBytes);
+  printf("Bytes moved:    %llu\n", (unsigned long long)movedBytes);
+  printf("Modelled time:  %.3f s\n\n", stats->timeUs / 1e6);
+  printf("op     calls      sectors    model avg [us]  model max [us]  field avg [us]\n");
+  for(uint32_t i = VIFLASH_TRACE_WRITE; i <= VIFLASH_TRACE_IOCTL; i++) {
+    if(0 == ops[i].calls)
+      continue;
+    printf("%-5s  %-9llu  %-9llu  %-14.1f  %-14.1f  ",
+      opNames[i], (unsigned long long)ops[i].calls, (unsigned long long)ops[i].sectors,
+      ops[i].timeUs / ops[i].calls, ops[i].maxUs);
+    if(0 != tickHz)
+      printf("%.1f\n", ops[i].fieldUs / ops[i].calls);
+    else
+      printf("-\n");
+  }
+
+  // the trace holds a hash of the data, not the data
+  printf("\nNote: written data is made up, erased writes excepted. %s\n"
+    "Programs and erases are an upper bound of the field.\n",
+    hashed ? "Writes with an equal hash get equal data, any other write differs in every byte."
+           : "The trace has no hashes, every write differs in every byte.");
+  exitCode = 0;
+
+done:
+  free(buff);
+  if(simflash)
+    SIMFLASH_Destroy();
+  fclose(trace);
+  return exitCode;
+}